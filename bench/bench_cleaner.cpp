@@ -0,0 +1,432 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../common/chunk_pipeline.h"
+#include "../common/column_plan.h"
+#include "../common/diagnostics.h"
+#include "../common/dialects.h"
+#include "../common/output_buffer.h"
+#include "../common/output_sinks.h"
+#include "../common/quantile_sketch.h"
+#include "../common/row_dedup.h"
+#include "../common/row_sampler.h"
+#include "../common/str_view.h"
+#include "../common/time_parser.h"
+#include "../common/tokenizer.h"
+#include "synthetic_data.h"
+
+// Microbenchmarks for the tokenizer, every column transform and whole rows
+// over synthetic data. Each benchmark is repeated for at least --min-time
+// seconds and reports ns per cell (or row) and MB/s of input text.
+
+struct BenchOptions {
+    SyntheticSpec spec;
+    double min_time = 0.3;
+    const char* filter = nullptr;
+};
+
+static uint64_t g_checksum = 0u;
+
+template <typename Fn>
+void run_bench(const BenchOptions& options, const char* name, size_t cells, size_t bytes,
+        Fn fn) {
+    if (options.filter != nullptr && strstr(name, options.filter) == nullptr) {
+        return;
+    }
+    typedef std::chrono::steady_clock Clock;
+    g_checksum += fn();
+    size_t iterations = 0u;
+    double elapsed = 0.0;
+    Clock::time_point start = Clock::now();
+    do {
+        g_checksum += fn();
+        ++iterations;
+        elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    } while (elapsed < options.min_time);
+    double ns = elapsed * 1e9 / (static_cast<double>(iterations) * cells);
+    double mbps = static_cast<double>(bytes) * iterations / elapsed / 1e6;
+    printf("%-36s %10zu %10.1f %10.1f\n", name, cells, ns, mbps);
+}
+
+static int build_plan(const SyntheticTable& table, OutputFormat format, ColumnPlan& plan) {
+    CleanerDialect dialect = root_dialect();
+    plan.format = format;
+    for (const auto& line : table.schema) {
+        if (add_feature_flag({line.data(), line.size()}, dialect, plan) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int parse_args(int argc, char* argv[], BenchOptions& options) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const char* arg = argv[i];
+        const char* value = argv[i + 1];
+        if (strcmp(arg, "--rows") == 0) {
+            options.spec.rows = strtoull(value, nullptr, 10);
+        } else if (strcmp(arg, "--cardinality") == 0) {
+            options.spec.cardinality = strtoull(value, nullptr, 10);
+        } else if (strcmp(arg, "--list-length") == 0) {
+            options.spec.list_length = strtoull(value, nullptr, 10);
+        } else if (strcmp(arg, "--null-rate") == 0) {
+            options.spec.null_rate = strtod(value, nullptr);
+        } else if (strcmp(arg, "--time-format") == 0) {
+            options.spec.time_format = value;
+        } else if (strcmp(arg, "--seed") == 0) {
+            options.spec.seed = strtoull(value, nullptr, 10);
+        } else if (strcmp(arg, "--min-time") == 0) {
+            options.min_time = strtod(value, nullptr);
+        } else if (strcmp(arg, "--filter") == 0) {
+            options.filter = value;
+        } else {
+            return -1;
+        }
+    }
+    if (argc % 2 == 0 || options.spec.rows == 0u || options.spec.cardinality == 0u ||
+            options.spec.list_length == 0u) {
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    if (parse_args(argc, argv, options) != 0) {
+        std::cerr << "Usage: " << argv[0] << " [--rows N] [--cardinality N] [--list-length N]"
+                  << " [--null-rate F] [--time-format FMT] [--seed N] [--min-time SECONDS]"
+                  << " [--filter NAME]" << std::endl;
+        return -1;
+    }
+    const SyntheticTable table = generate_synthetic(options.spec);
+    const auto& cells = table.cells;
+
+    ColumnPlan plan;
+    if (build_plan(table, OUTPUT_TEXT, plan) != 0) {
+        return -1;
+    }
+    DiagnosticCounters counters;
+    ThreadContext thread(plan, counters);
+    SinkBuffers output(false, 1u << 24);
+    LineContext ctx = line_context(thread, output);
+    // the transforms are benchmarked on non null cells only, as in clean_line.
+    std::vector<StrView> views[SYN_COLUMNS];
+    for (int c = 0; c < SYN_COLUMNS; ++c) {
+        for (const auto& cell : cells[c]) {
+            if (cell != "null") {
+                views[c].push_back({cell.data(), cell.size()});
+            }
+        }
+    }
+    auto view_bytes = [](const std::vector<StrView>& v) {
+        size_t size = 0u;
+        for (const auto& s : v) {
+            size += s.size;
+        }
+        return size;
+    };
+
+    printf("rows %zu, cardinality %zu, list length %zu, null rate %.3f, time format %s\n",
+            options.spec.rows, options.spec.cardinality, options.spec.list_length,
+            options.spec.null_rate, options.spec.time_format.c_str());
+    printf("%-36s %10s %10s %10s\n", "benchmark", "cells", "ns/cell", "MB/s");
+
+    std::vector<StrView> lines;
+    for_each_line(table.tsv.data(), table.tsv.size(), [&lines](StrView line) {
+        lines.push_back(line);
+    });
+    run_bench(options, "tokenizer split_line (rows)", lines.size(), table.tsv.size(), [&] {
+        uint64_t sum = 0u;
+        for (const auto& line : lines) {
+            sum += thread.tokenizer.split_line(line).size();
+        }
+        return sum;
+    });
+    // the same rows as RFC 4180 CSV, the lists quoted.
+    std::string csv;
+    for (size_t r = 0u; r < options.spec.rows; ++r) {
+        for (int c = 0; c < SYN_COLUMNS; ++c) {
+            const std::string& cell = cells[c][r];
+            if (cell.find_first_of(",\"") == std::string::npos) {
+                csv += cell;
+            } else {
+                csv += '"';
+                for (char ch : cell) {
+                    csv += ch;
+                    if (ch == '"') {
+                        csv += '"';
+                    }
+                }
+                csv += '"';
+            }
+            csv += c + 1 < SYN_COLUMNS ? ',' : '\n';
+        }
+    }
+    std::vector<StrView> csv_lines;
+    for_each_record(csv.data(), csv.size(), true, [&csv_lines](StrView line) {
+        csv_lines.push_back(line);
+    });
+    Tokenizer csv_tokenizer(',', plan.sub_delims(), true);
+    run_bench(options, "tokenizer split_line (rows, csv)", csv_lines.size(), csv.size(), [&] {
+        uint64_t sum = 0u;
+        for (const auto& line : csv_lines) {
+            sum += csv_tokenizer.split_line(line).size();
+        }
+        return sum;
+    });
+    run_bench(options, "for_each_record (csv)", csv_lines.size(), csv.size(), [&] {
+        uint64_t sum = 0u;
+        for_each_record(csv.data(), csv.size(), true, [&sum](StrView line) {
+            sum += line.size;
+        });
+        return sum;
+    });
+    run_bench(options, "for_each_line (tsv)", lines.size(), table.tsv.size(), [&] {
+        uint64_t sum = 0u;
+        for_each_line(table.tsv.data(), table.tsv.size(), [&sum](StrView line) {
+            sum += line.size;
+        });
+        return sum;
+    });
+    // 300 column rows of which 40 are read, the shape of the raw tables most
+    // schemas project from: all fields, the first 40 (the scan stops early)
+    // and every 7th (only trimming is saved).
+    const size_t WIDE_COLUMNS = 300u;
+    std::string wide_tsv;
+    for (size_t r = 0u; r < std::min<size_t>(options.spec.rows, 10000u); ++r) {
+        for (size_t c = 0u; c < WIDE_COLUMNS; ++c) {
+            wide_tsv += cells[c % SYN_COLUMNS][r];
+            wide_tsv += c + 1u < WIDE_COLUMNS ? '\t' : '\n';
+        }
+    }
+    std::vector<StrView> wide_lines;
+    for_each_line(wide_tsv.data(), wide_tsv.size(), [&wide_lines](StrView line) {
+        wide_lines.push_back(line);
+    });
+    std::vector<bool> first_used(WIDE_COLUMNS), spread_used(WIDE_COLUMNS);
+    for (size_t c = 0u; c < 40u; ++c) {
+        first_used[c] = true;
+        spread_used[c * 7u] = true;
+    }
+    const struct {
+        const char* name;
+        const std::vector<bool>* needed;
+    } wide_benches[] = {
+        {"split_line 300 columns (all)", nullptr},
+        {"split_line 300 columns (first 40)", &first_used},
+        {"split_line 300 columns (every 7th)", &spread_used},
+    };
+    for (const auto& bench : wide_benches) {
+        Tokenizer wide(thread.tokenizer);
+        wide.project(bench.needed != nullptr ? *bench.needed : std::vector<bool>());
+        run_bench(options, bench.name, wide_lines.size(), wide_tsv.size(), [&] {
+            uint64_t sum = 0u;
+            for (const auto& line : wide_lines) {
+                sum += wide.split_line(line).size();
+            }
+            return sum;
+        });
+    }
+    const auto& lists = views[SYN_MULTI_CAT];
+    run_bench(options, "split+trim_tokens (lists)", lists.size(), view_bytes(lists), [&] {
+        uint64_t sum = 0u;
+        for (const auto& cell : lists) {
+            auto tokens = split(cell, ',');
+            trim_tokens(tokens);
+            sum += tokens.size();
+        }
+        return sum;
+    });
+    std::vector<StrView> items;
+    for (const auto& cell : lists) {
+        const auto& subtokens = thread.tokenizer.split_field(cell, ',');
+        items.insert(items.end(), subtokens.begin(), subtokens.end());
+    }
+    std::vector<uint64_t> item_hashes(items.size());
+    run_bench(options, "MurmurHash64A (list items)", items.size(), view_bytes(items), [&] {
+        for (size_t i = 0u; i < items.size(); ++i) {
+            item_hashes[i] = MurmurHash64A(items[i].data, items[i].size, SIGN_SEED);
+        }
+        return item_hashes.back();
+    });
+    run_bench(options, "MurmurHash64A_batch (list items)", items.size(), view_bytes(items), [&] {
+        MurmurHash64A_batch(items.data(), items.size(), SIGN_SEED, item_hashes.data());
+        return item_hashes.back();
+    });
+    const auto& cats = views[SYN_CAT];
+    run_bench(options, "MurmurHash64A (categorical)", cats.size(), view_bytes(cats), [&] {
+        uint64_t sum = 0u;
+        for (const auto& cell : cats) {
+            sum += MurmurHash64A(cell.data, cell.size, SIGN_SEED);
+        }
+        return sum;
+    });
+    const Column& time_column = plan.columns[SYN_TIME];
+    const auto& times = views[SYN_TIME];
+    run_bench(options, "calc_time (get_time+mktime)", times.size(), view_bytes(times), [&] {
+        uint64_t sum = 0u;
+        for (const auto& cell : times) {
+            sum += calc_time(cell, time_column.time_format.c_str(), ctx);
+        }
+        return sum;
+    });
+    if (time_column.time_layout != TIME_GENERIC) {
+        run_bench(options, "parse_time_fast", times.size(), view_bytes(times), [&] {
+            uint64_t sum = 0u;
+            for (const auto& cell : times) {
+                time_t t = 0;
+                parse_time_fast(cell, time_column.time_layout, thread.time_cache, t);
+                sum += t;
+            }
+            return sum;
+        });
+    }
+    const auto& nums = views[SYN_NUM];
+    run_bench(options, "view_strtod (numerical)", nums.size(), view_bytes(nums), [&] {
+        double sum = 0.0;
+        for (const auto& cell : nums) {
+            sum += view_strtod(cell);
+        }
+        return static_cast<uint64_t>(sum);
+    });
+    QuantileSketch sketch;
+    std::vector<double> values;
+    for (const auto& cell : nums) {
+        values.push_back(view_strtod(cell));
+        sketch.add(values.back());
+    }
+    run_bench(options, "QuantileSketch add", values.size(), view_bytes(nums), [&] {
+        QuantileSketch fit;
+        for (double value : values) {
+            fit.add(value);
+        }
+        return fit.count();
+    });
+    const std::vector<double> bounds = sketch.boundaries(64u);
+    run_bench(options, "bucket_index (64 buckets)", values.size(), view_bytes(nums), [&] {
+        uint64_t sum = 0u;
+        for (double value : values) {
+            sum += bucket_index(bounds, value);
+        }
+        return sum;
+    });
+    const Column& catnum_column = plan.columns[SYN_MULTI_CAT_NUM];
+    const auto& catnums = views[SYN_MULTI_CAT_NUM];
+    run_bench(options, "CatNumerical max/min", catnums.size(), view_bytes(catnums), [&] {
+        output.instances.clear();
+        for (const auto& cell : catnums) {
+            transform_multi_cat_num(catnum_column, cell, ctx);
+        }
+        return output.instances.size();
+    });
+    Column topk_column = catnum_column;
+    topk_column.catnum_flag = CatnumFlag::TOPK;
+    topk_column.catnum_k = 3u;
+    run_bench(options, "CatNumerical TopK#3", catnums.size(), view_bytes(catnums), [&] {
+        output.instances.clear();
+        for (const auto& cell : catnums) {
+            transform_multi_cat_num(topk_column, cell, ctx);
+        }
+        return output.instances.size();
+    });
+
+    std::vector<uint64_t> signs;
+    std::vector<double> doubles;
+    for (const auto& cell : cats) {
+        signs.push_back(MurmurHash64A(cell.data, cell.size, SIGN_SEED));
+    }
+    for (const auto& cell : nums) {
+        doubles.push_back(view_strtod(cell) + 0.5);
+    }
+    run_bench(options, "format signs", signs.size(), view_bytes(cats), [&] {
+        output.instances.clear();
+        for (uint64_t sign : signs) {
+            output.instances << static_cast<unsigned long long>(sign) << ' ';
+        }
+        return output.instances.size();
+    });
+    run_bench(options, "format doubles", doubles.size(), view_bytes(nums), [&] {
+        output.instances.clear();
+        for (double value : doubles) {
+            output.instances << value << ' ';
+        }
+        return output.instances.size();
+    });
+
+    // --dedup keys: the default false positive rate, a filter far larger than
+    // the caches, and every key new until it is full.
+    BlockedBloomFilter filter;
+    if (filter.init(1u << 24, 0.001) != 0) {
+        return -1;
+    }
+    std::vector<uint64_t> keys(lines.size());
+    uint64_t next_key = 0u;
+    run_bench(options, "BlockedBloomFilter test_and_add (rows)", lines.size(),
+            table.tsv.size(), [&] {
+        for (auto& key : keys) {
+            ++next_key;
+            key = MurmurHash64A(&next_key, sizeof(next_key), SIGN_SEED);
+        }
+        size_t seen = 0u;
+        for (uint64_t key : keys) {
+            seen += filter.test_and_add(key);
+        }
+        return seen;
+    });
+
+    const struct {
+        const char* name;
+        OutputFormat format;
+    } row_benches[] = {
+        {"clean_line text (rows)", OUTPUT_TEXT},
+        {"clean_line binary (rows)", OUTPUT_BINARY},
+        {"clean_line libffm (rows)", OUTPUT_LIBFFM},
+    };
+    for (const auto& bench : row_benches) {
+        ColumnPlan row_plan;
+        if (build_plan(table, bench.format, row_plan) != 0) {
+            return -1;
+        }
+        ThreadContext row_thread(row_plan, counters);
+        run_bench(options, bench.name, lines.size(), table.tsv.size(), [&] {
+            output.instances.clear();
+            output.labels.clear();
+            output.diag().clear();
+            for (const auto& line : lines) {
+                clean_line(row_plan, line, row_thread, output);
+            }
+            return output.instances.size();
+        });
+    }
+
+    // negatives (70% of the rows) downsampled 10:1 before the transforms.
+    ColumnPlan sampled_plan;
+    if (build_plan(table, OUTPUT_TEXT, sampled_plan) != 0) {
+        return -1;
+    }
+    RowSampler sampler;
+    if (sampler.init(1.0, "0:0.1", nullptr, 0u, 0u, sampled_plan.columns.size(),
+            sampled_plan.label_column) != 0) {
+        return -1;
+    }
+    sampled_plan.sampler = &sampler;
+    ThreadContext sampled_thread(sampled_plan, counters);
+    run_bench(options, "clean_line text (rows, 0:0.1)", lines.size(), table.tsv.size(), [&] {
+        output.instances.clear();
+        output.labels.clear();
+        output.diag().clear();
+        for (const auto& line : lines) {
+            clean_line(sampled_plan, line, sampled_thread, output);
+        }
+        return output.instances.size();
+    });
+    printf("checksum %llu\n", static_cast<unsigned long long>(g_checksum));
+    return 0;
+}
@@ -0,0 +1,89 @@
+#ifndef DATA_CLEANER_BENCH_SYNTHETIC_DATA_H
+#define DATA_CLEANER_BENCH_SYNTHETIC_DATA_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <ctime>
+#include <random>
+#include <string>
+#include <vector>
+
+// Shape of the generated input.
+struct SyntheticSpec {
+    size_t rows = 100000u;
+    // distinct values per Categorical / Multi-Valued column.
+    size_t cardinality = 1000u;
+    // mean number of items in a Multi-Valued cell.
+    size_t list_length = 5u;
+    // share of cells that are "null".
+    double null_rate = 0.05;
+    std::string time_format = "%Y-%m-%d %H:%M:%S";
+    uint64_t seed = 42u;
+};
+
+// Columns of the generated schema, in order.
+enum SyntheticColumn : int {
+    SYN_LABEL = 0,
+    SYN_CAT = 1,
+    SYN_MULTI_CAT = 2,
+    SYN_MULTI_CAT_NUM = 3,
+    SYN_NUM = 4,
+    SYN_TIME = 5,
+    SYN_COLUMNS = 6
+};
+
+// Tab separated rows in the root data_clean dialect (',' lists and ';' ':'
+// CatNumerical pairs), the schema lines describing them and every cell by
+// column for the per transform benchmarks.
+struct SyntheticTable {
+    std::vector<std::string> schema;
+    std::string tsv;
+    std::vector<std::string> cells[SYN_COLUMNS];
+};
+
+inline SyntheticTable generate_synthetic(const SyntheticSpec& spec) {
+    SyntheticTable table;
+    table.schema = {"Label", "Categorical", "Multi-Valued Categorical",
+        "Multi-Valued CatNumerical#MaxMin", "Numerical", "Time#" + spec.time_format};
+
+    std::mt19937_64 rng(spec.seed);
+    std::uniform_int_distribution<size_t> value(0u, spec.cardinality - 1u);
+    std::uniform_int_distribution<size_t> length(1u, spec.list_length * 2u - 1u);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    // 2020-01-01 .. 2021-01-01 UTC.
+    std::uniform_int_distribution<int64_t> seconds(1577836800, 1609459200);
+
+    char buf[64];
+    for (size_t r = 0u; r < spec.rows; ++r) {
+        std::string row[SYN_COLUMNS];
+        row[SYN_LABEL] = unit(rng) < 0.3 ? "1" : "0";
+        row[SYN_CAT] = "c" + std::to_string(value(rng));
+        for (size_t i = 0u, n = length(rng); i < n; ++i) {
+            row[SYN_MULTI_CAT] += (i ? "," : "") + ("m" + std::to_string(value(rng)));
+        }
+        for (size_t i = 0u, n = length(rng); i < n; ++i) {
+            snprintf(buf, sizeof(buf), "%sk%zu:%.3f", i ? ";" : "", value(rng),
+                    unit(rng) * 100.0);
+            row[SYN_MULTI_CAT_NUM] += buf;
+        }
+        snprintf(buf, sizeof(buf), "%.4f", (unit(rng) - 0.5) * 200.0);
+        row[SYN_NUM] = buf;
+        time_t t = static_cast<time_t>(seconds(rng));
+        std::tm tm;
+        gmtime_r(&t, &tm);
+        strftime(buf, sizeof(buf), spec.time_format.c_str(), &tm);
+        row[SYN_TIME] = buf;
+
+        for (int c = 0; c < SYN_COLUMNS; ++c) {
+            if (c != SYN_LABEL && unit(rng) < spec.null_rate) {
+                row[c] = "null";
+            }
+            table.tsv += row[c];
+            table.tsv += c + 1 == SYN_COLUMNS ? '\n' : '\t';
+            table.cells[c].push_back(row[c]);
+        }
+    }
+    return table;
+}
+
+#endif // DATA_CLEANER_BENCH_SYNTHETIC_DATA_H
@@ -0,0 +1,234 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <string>
+
+#include "../common/MurmurHash3.h"
+#include "../common/float_parser.h"
+
+// Checks parse_float against strtod in the "C" locale: the same length read
+// and the same bits (any NaN of the same sign for NaN). Covers fixed edge
+// cases (subnormals, the limits, halfway values, inf/nan, hex floats, white
+// space, partial numbers), random doubles printed in every printf style,
+// random decimal strings, exact midpoints between neighbouring doubles and
+// numbers cut short by the length of the view. Exits non zero on the first
+// mismatch.
+
+static uint64_t g_state = 1u;
+static size_t g_checked = 0u;
+
+// parse_float of the first `size` bytes of `text` against strtod of a copy
+// that ends there; `text` goes on with digits so reads past `size` show.
+static bool check(const std::string& text, size_t size) {
+    std::string bounded = text.substr(0u, size);
+    char* end = nullptr;
+    double expected = strtod(bounded.c_str(), &end);
+    size_t expected_size = end - bounded.c_str();
+    std::string padded = text.substr(0u, size) + "123e5";
+    double value = 0.0;
+    size_t read = parse_float(padded.data(), size, value);
+    bool same = read == expected_size &&
+        (std::isnan(expected) ? std::isnan(value) && std::signbit(value) == std::signbit(expected)
+                              : memcmp(&value, &expected, sizeof(value)) == 0);
+    if (!same) {
+        fprintf(stderr, "[%s]: parse_float read %zu bytes as %.17g (%a), strtod %zu bytes as"
+                " %.17g (%a)\n", bounded.c_str(), read, value, value, expected_size, expected,
+                expected);
+        return false;
+    }
+    ++g_checked;
+    return true;
+}
+
+static bool check(const std::string& text) {
+    return check(text, text.size());
+}
+
+static double random_double() {
+    uint64_t bits = splitmix64(g_state);
+    double value = 0.0;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static std::string format(const char* fmt, double value, int precision) {
+    char buf[1200];
+    snprintf(buf, sizeof(buf), fmt, precision, value);
+    return buf;
+}
+
+static const char* const EDGE_CASES[] = {
+    "0", "-0", "+0", "0.0", "-0.0", "0e0", "0e-999999999", "0e999999999", "00000", ".0", "0.",
+    "1", "-1", "+1", ".5", "5.", "-.5", "1e", "1e+", "1e-", "1e+5", "1E5", "1e-5", "1.5e3x",
+    "", "-", "+", ".", "-.", "e5", ".e5", "x", "--1", "+-1", " 1", "\t-2.5", "\n3", "1 ", "1_000",
+    "4.9406564584124654e-324", "4.9406564584124653e-324", "5e-324", "3e-324", "2e-324",
+    "2.4703282292062327e-324", "2.4703282292062328e-324", "2.4703282292062327208828e-324",
+    "1e-324", "1e-400", "-1e-400", "2.2250738585072011e-308", "2.2250738585072012e-308",
+    "2.2250738585072014e-308", "2.225073858507201136057409796709131975934819546351645648e-308",
+    "4.4501477170144023e-308", "1.7976931348623157e308", "1.7976931348623158e308",
+    "1.7976931348623159e308", "-1.7976931348623159e308", "1e308", "1e309", "1e400", "-1e400",
+    "17976931348623158079372897140530341507993413271003782693617377898044496829276475"
+    "09466490179775872070963302864166928879109465555478519404026306574886715058206819"
+    "08902000708383676273854845817711531764475730270069855571366959622842914819860834"
+    "936475292719074168444365510704342711559699508093042880177904174497792",
+    "17976931348623158079372897140530341507993413271003782693617377898044496829276475"
+    "09466490179775872070963302864166928879109465555478519404026306574886715058206819"
+    "08902000708383676273854845817711531764475730270069855571366959622842914819860834"
+    "936475292719074168444365510704342711559699508093042880177904174497791",
+    "9007199254740992", "9007199254740993", "9007199254740994", "9007199254740995",
+    "9007199254740993.0000000000000000001", "9007199254740992.9999999999999999999",
+    "9.007199254740993e15", "900719925474099.3e1", "18014398509481985", "18014398509481987",
+    "0.1", "0.2", "0.3", "0.30000000000000004",
+    "1.00000000000000011102230246251565404236316680908203125",
+    "1.00000000000000011102230246251565404236316680908203124",
+    "1.00000000000000011102230246251565404236316680908203126",
+    "7.0420557077594588669468784357561207962098443483187940792729600000e+59",
+    "1448997445238699", "123456789012345678901234567890", "0.000000000000000000000000000001",
+    "00000000000000000000000000000000000000000001.5", "1.00000000000000000000000000000000000000000",
+    "18446744073709551615", "18446744073709551616", "99999999999999999999", "1e23", "8.41e21",
+    "inf", "-inf", "+inf", "INF", "Inf", "infinity", "-Infinity", "INFINITY", "infinit", "infx",
+    "in", "i", "nan", "-nan", "+nan", "NaN", "NAN", "nan()", "nan(123)", "nan(abc_1)", "-nan(x)",
+    "nan(", "nan(1", "nan(-)", "nan(1)x", "na", "n",
+    "0x1p-1074", "0x1p-1075", "0x1.8p-1074", "0x1.fffffffffffffp+1023", "0x1.fffffffffffff8p+1023",
+    "0X1P+0", "0x.8p1", "0x1", "-0x10", "0x", "0xg", "0x1p", "0x1.p", "0x.p1",
+    "0x1.0000000000000000008p0",
+};
+
+int main(int argc, char* argv[]) {
+    size_t rounds = argc > 1 ? strtoull(argv[1], nullptr, 10) : 200000u;
+    for (const char* text : EDGE_CASES) {
+        if (!check(text)) {
+            return 1;
+        }
+    }
+    printf("%-20s ok\n", "edge cases");
+
+    // random bit patterns, subnormals, NaNs and infinities included, in
+    // every printf style and precision.
+    static const char* const FORMATS[] = {"%.*g", "%.*e", "%.*f", "%.*a", "%.*G", "%.*E", "%.*A"};
+    for (size_t round = 0u; round < rounds; ++round) {
+        double value = random_double();
+        if (round % 4u == 0u) {
+            // subnormal
+            uint64_t bits = splitmix64(g_state) & 0x800fffffffffffffull;
+            memcpy(&value, &bits, sizeof(value));
+        } else if (round % 4u == 1u) {
+            // the range where short decimals are common.
+            value = std::ldexp(static_cast<double>(splitmix64(g_state) >> 11),
+                    static_cast<int>(splitmix64(g_state) % 140u) - 110);
+        }
+        const char* fmt = FORMATS[splitmix64(g_state) % 7u];
+        int precision = static_cast<int>(splitmix64(g_state) % 26u);
+        if (fmt[3] == 'f' && std::fabs(value) > 1e30) {
+            fmt = "%.*e";
+        }
+        if (!check(format(fmt, value, precision)) || !check(format("%.*g", value, 17)) ||
+                !check(format("%.*g", value, 15))) {
+            return 1;
+        }
+    }
+    printf("%-20s ok\n", "printed doubles");
+
+    // random decimals: up to 40 digits, a point anywhere, exponents far out
+    // of range.
+    for (size_t round = 0u; round < rounds; ++round) {
+        std::string text;
+        uint64_t r = splitmix64(g_state);
+        if (r % 3u == 0u) {
+            text += r % 2u ? "-" : "+";
+        }
+        size_t digits = 1u + splitmix64(g_state) % 40u;
+        size_t point = splitmix64(g_state) % (digits + 2u);
+        for (size_t i = 0u; i < digits; ++i) {
+            if (i == point) {
+                text += '.';
+            }
+            text += static_cast<char>('0' + splitmix64(g_state) % 10u);
+        }
+        if (splitmix64(g_state) % 2u) {
+            text += "e" + std::to_string(static_cast<int>(splitmix64(g_state) % 700u) - 350);
+        }
+        if (!check(text)) {
+            return 1;
+        }
+    }
+    printf("%-20s ok\n", "random decimals");
+
+    // exact midpoints between neighbouring doubles, which round to even:
+    // short integers at and above 2^53, and the full expansions of random
+    // ones, subnormals included, with the digits just below and above.
+    for (size_t round = 0u; round < rounds; ++round) {
+        uint64_t mantissa = (splitmix64(g_state) >> 11) | (1ull << 52);
+        int shift = static_cast<int>(splitmix64(g_state) % 11u);
+        unsigned long long mid = (mantissa << shift) + (1ull << shift >> 1);
+        if (shift == 0) {
+            // odd integers above 2^53
+            mid = (mantissa << 1) | 1u;
+        }
+        std::string text = std::to_string(mid);
+        if (!check(text) || !check(text + "e0") ||
+                !check(text.substr(0u, 1u) + "." + text.substr(1u) + "e" +
+                       std::to_string(text.size() - 1u))) {
+            return 1;
+        }
+        if (round % 16u != 0u) {
+            continue;
+        }
+        double low = std::fabs(random_double());
+        if (round % 32u == 0u) {
+            uint64_t bits = splitmix64(g_state) & 0x000fffffffffffffull;
+            memcpy(&low, &bits, sizeof(low));
+        }
+        double high = std::nextafter(low, std::numeric_limits<double>::infinity());
+        if (!std::isfinite(high)) {
+            continue;
+        }
+        long double exact = (static_cast<long double>(low) + high) / 2.0L;
+        char buf[1200];
+        snprintf(buf, sizeof(buf), "%.800Le", exact);
+        std::string expansion = buf;
+        size_t e = expansion.find('e');
+        std::string digits = expansion.substr(0u, e);
+        std::string exponent = expansion.substr(e);
+        digits.erase(digits.find_last_not_of('0') + 1u);
+        if (!check(digits + exponent) || !check(digits + "1" + exponent)) {
+            return 1;
+        }
+        // one unit less in the last digit, the midpoint of a subnormal or
+        // of a long mantissa ends in 5.
+        if (digits.back() == '5') {
+            std::string below = digits;
+            below.back() = '4';
+            if (!check(below + "9999999999" + exponent)) {
+                return 1;
+            }
+        }
+    }
+    printf("%-20s ok\n", "halfway values");
+
+    // views that end inside a number: every prefix of some of the above.
+    for (size_t round = 0u; round < rounds / 10u; ++round) {
+        std::string text = format("%.*g", random_double(), 17);
+        if (round % 2u) {
+            text = format("%.*a", random_double(), 13);
+        }
+        for (size_t size = 0u; size <= text.size(); ++size) {
+            if (!check(text, size)) {
+                return 1;
+            }
+        }
+    }
+    for (const char* text : EDGE_CASES) {
+        for (size_t size = 0u; size <= strlen(text); ++size) {
+            if (!check(text, size)) {
+                return 1;
+            }
+        }
+    }
+    printf("%-20s ok\n", "bounded views");
+    printf("parse_float: %zu strings match strtod\n", g_checked);
+    return 0;
+}
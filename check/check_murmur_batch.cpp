@@ -0,0 +1,154 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../common/MurmurHash3.h"
+#include "../common/str_view.h"
+
+// Checks MurmurHash64A_batch against MurmurHash64A, bit for bit, with every
+// kernel the CPU supports: keys of random lengths and bytes, groups of every
+// size, groups of long keys that the batch entry points do not leave to the
+// scalar loop, and keys that end right before or start right after an
+// unreadable page, which catches loads outside the key. Exits non zero on
+// the first mismatch.
+
+typedef void (*BatchFn)(const StrView* keys, size_t count, unsigned int seed, uint64_t* out);
+
+struct Kernel {
+    const char* name;
+    BatchFn batch;
+    // hashes exactly `lanes` keys with the SIMD kernel whatever their sizes.
+    BatchFn lanes_fn;
+    size_t lanes;
+};
+
+static uint64_t g_state = 1u;
+static size_t g_checked = 0u;
+
+static void random_bytes(char* data, size_t size) {
+    for (size_t i = 0u; i < size; ++i) {
+        data[i] = static_cast<char>(splitmix64(g_state));
+    }
+}
+
+static bool check(const Kernel& kernel, const char* what, const StrView* keys, size_t count,
+        unsigned int seed, bool lanes) {
+    std::vector<uint64_t> out(count, 0u);
+    if (lanes) {
+        kernel.lanes_fn(keys, count, seed, out.data());
+    } else {
+        kernel.batch(keys, count, seed, out.data());
+    }
+    for (size_t i = 0u; i < count; ++i) {
+        uint64_t expected = MurmurHash64A(keys[i].data, static_cast<int>(keys[i].size), seed);
+        if (out[i] != expected) {
+            fprintf(stderr, "%s %s: key %zu of %zu (size %zu, seed %u) hashed to %016llx,"
+                    " MurmurHash64A gives %016llx\n", kernel.name, what, i, count, keys[i].size,
+                    seed, static_cast<unsigned long long>(out[i]),
+                    static_cast<unsigned long long>(expected));
+            return false;
+        }
+    }
+    g_checked += count;
+    return true;
+}
+
+template <void (*Fn)(const StrView*, unsigned int, uint64_t*)>
+void lanes_adapter(const StrView* keys, size_t, unsigned int seed, uint64_t* out) {
+    Fn(keys, seed, out);
+}
+
+static std::vector<Kernel> supported_kernels() {
+    std::vector<Kernel> kernels;
+    kernels.push_back({"scalar", murmur64a_batch_scalar<StrView>, nullptr, 0u});
+#ifdef DATA_CLEANER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        kernels.push_back({"avx2", murmur64a_batch_avx2<StrView>,
+                lanes_adapter<murmur64a_x4_avx2<StrView>>, 4u});
+    }
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq")) {
+        kernels.push_back({"avx512", murmur64a_batch_avx512<StrView>,
+                lanes_adapter<murmur64a_x8_avx512<StrView>>, 8u});
+    }
+#endif
+    kernels.push_back({"dispatch", MurmurHash64A_batch<StrView>, nullptr, 0u});
+    return kernels;
+}
+
+int main(int argc, char* argv[]) {
+    size_t rounds = argc > 1 ? strtoull(argv[1], nullptr, 10) : 20000u;
+    std::vector<Kernel> kernels = supported_kernels();
+
+    // one readable page between two unreadable ones.
+    const size_t page = sysconf(_SC_PAGESIZE);
+    char* region = static_cast<char*>(mmap(nullptr, 3u * page, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (region == MAP_FAILED || mprotect(region, page, PROT_NONE) != 0 ||
+            mprotect(region + 2u * page, page, PROT_NONE) != 0) {
+        perror("mmap");
+        return 1;
+    }
+    char* guarded = region + page;
+    random_bytes(guarded, page);
+
+    std::string pool(1u << 16, '\0');
+    random_bytes(&pool[0], pool.size());
+    const unsigned int seeds[] = {0u, 32u, 0xffffffffu};
+    std::vector<StrView> keys;
+    for (const Kernel& kernel : kernels) {
+        for (size_t round = 0u; round < rounds; ++round) {
+            unsigned int seed = round < 3u ? seeds[round] : static_cast<unsigned int>(
+                splitmix64(g_state));
+            // random lengths, mostly short as list items are, and every group
+            // size up to 19 so each remainder is taken.
+            size_t count = round % 20u;
+            size_t max_size = round % 2u == 0u ? 24u : 100u;
+            keys.clear();
+            for (size_t i = 0u; i < count; ++i) {
+                size_t size = splitmix64(g_state) % (max_size + 1u);
+                size_t offset = splitmix64(g_state) % (pool.size() - size);
+                keys.push_back({pool.data() + offset, size});
+            }
+            if (!check(kernel, "batch", keys.data(), keys.size(), seed, false)) {
+                return 1;
+            }
+            if (kernel.lanes == 0u) {
+                continue;
+            }
+            // a full group hashed in the lanes, long keys or not.
+            keys.clear();
+            for (size_t i = 0u; i < kernel.lanes; ++i) {
+                size_t size = splitmix64(g_state) % 100u;
+                size_t offset = splitmix64(g_state) % (pool.size() - size);
+                keys.push_back({pool.data() + offset, size});
+            }
+            if (!check(kernel, "lanes", keys.data(), keys.size(), seed, true)) {
+                return 1;
+            }
+        }
+        // keys against the unreadable pages: every size up to 80 ending at
+        // the end of the page and starting at its start.
+        for (size_t size = 0u; size <= 80u; ++size) {
+            keys.assign(kernel.lanes == 0u ? 4u : kernel.lanes,
+                    StrView{guarded + page - size, size});
+            for (size_t i = 1u; i < keys.size(); i += 2u) {
+                keys[i] = StrView{guarded, size};
+            }
+            if (!check(kernel, "page edge", keys.data(), keys.size(), 32u, false) ||
+                    (kernel.lanes != 0u &&
+                     !check(kernel, "page edge lanes", keys.data(), keys.size(), 32u, true))) {
+                return 1;
+            }
+        }
+        printf("%-10s ok\n", kernel.name);
+    }
+    printf("MurmurHash64A_batch: %zu keys match MurmurHash64A\n", g_checked);
+    munmap(region, 3u * page);
+    return 0;
+}
@@ -0,0 +1,323 @@
+#ifndef DATA_CLEANER_MURMURHASH3_H
+#define DATA_CLEANER_MURMURHASH3_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DATA_CLEANER_X86 1
+#endif
+
+//typedef unsigned __int64 uint64_t;
+
+// 64-bit hash for 64-bit platforms
+
+inline uint64_t MurmurHash64A ( const void * key, int len, unsigned int seed )
+{
+	const uint64_t m = 0xc6a4a7935bd1e995;
+	const int r = 47;
+
+	uint64_t h = seed ^ (len * m);
+
+	const uint64_t * data = (const uint64_t *)key;
+	const uint64_t * end = data + (len/8);
+
+	while(data != end)
+	{
+		uint64_t k = *data++;
+
+		k *= m; 
+		k ^= k >> r; 
+		k *= m; 
+		
+		h ^= k;
+		h *= m; 
+	}
+
+	const unsigned char * data2 = (const unsigned char*)data;
+
+	switch(len & 7)
+	{
+	case 7: h ^= uint64_t(data2[6]) << 48;
+	case 6: h ^= uint64_t(data2[5]) << 40;
+	case 5: h ^= uint64_t(data2[4]) << 32;
+	case 4: h ^= uint64_t(data2[3]) << 24;
+	case 3: h ^= uint64_t(data2[2]) << 16;
+	case 2: h ^= uint64_t(data2[1]) << 8;
+	case 1: h ^= uint64_t(data2[0]);
+	        h *= m;
+	};
+ 
+	h ^= h >> r;
+	h *= m;
+	h ^= h >> r;
+
+	return h;
+} 
+
+
+// 64-bit hash for 32-bit platforms
+
+inline uint64_t MurmurHash64B ( const void * key, int len, unsigned int seed )
+{
+	const unsigned int m = 0x5bd1e995;
+	const int r = 24;
+
+	unsigned int h1 = seed ^ len;
+	unsigned int h2 = 0;
+
+	const unsigned int * data = (const unsigned int *)key;
+
+	while(len >= 8)
+	{
+		unsigned int k1 = *data++;
+		k1 *= m; k1 ^= k1 >> r; k1 *= m;
+		h1 *= m; h1 ^= k1;
+		len -= 4;
+
+		unsigned int k2 = *data++;
+		k2 *= m; k2 ^= k2 >> r; k2 *= m;
+		h2 *= m; h2 ^= k2;
+		len -= 4;
+	}
+
+	if(len >= 4)
+	{
+		unsigned int k1 = *data++;
+		k1 *= m; k1 ^= k1 >> r; k1 *= m;
+		h1 *= m; h1 ^= k1;
+		len -= 4;
+	}
+
+	switch(len)
+	{
+	case 3: h2 ^= ((unsigned char*)data)[2] << 16;
+	case 2: h2 ^= ((unsigned char*)data)[1] << 8;
+	case 1: h2 ^= ((unsigned char*)data)[0];
+			h2 *= m;
+	};
+
+	h1 ^= h2 >> 18; h1 *= m;
+	h2 ^= h1 >> 22; h2 *= m;
+	h1 ^= h2 >> 17; h1 *= m;
+	h2 ^= h1 >> 19; h2 *= m;
+
+	uint64_t h = h1;
+
+	h = (h << 32) | h2;
+
+	return h;
+} 
+
+// MurmurHash64A of many keys at once: out[i] is MurmurHash64A of keys[i],
+// bit for bit, where a Key is anything with `data` and `size` members (a
+// StrView). The SIMD kernels hash 4 (AVX2) or 8 (AVX-512) keys per step,
+// one key per 64 bit lane; lanes whose key has no more blocks are masked
+// off, so keys of different lengths share a step. Blocks and tails are
+// loaded with plain loads that stay inside the key.
+const uint64_t MURMUR64A_M = 0xc6a4a7935bd1e995ull;
+
+// the last len & 7 bytes of a key as one little endian word. Overlapping
+// loads put it together without a byte loop: the 8 bytes ending the key
+// shifted right, or two 4 byte words or three single bytes of short keys.
+inline uint64_t murmur64a_tail(const char* data, size_t size) {
+    size_t n = size & 7u;
+    if (n == 0u) {
+        return 0u;
+    }
+    if (size >= 8u) {
+        uint64_t word = 0u;
+        memcpy(&word, data + size - 8u, 8u);
+        return word >> (64u - 8u * n);
+    }
+    if (n >= 4u) {
+        uint32_t lo = 0u, hi = 0u;
+        memcpy(&lo, data, 4u);
+        memcpy(&hi, data + n - 4u, 4u);
+        return uint64_t(lo) | (uint64_t(hi) << (8u * (n - 4u)));
+    }
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    return uint64_t(bytes[0]) | (uint64_t(bytes[n / 2u]) << (8u * (n / 2u))) |
+        (uint64_t(bytes[n - 1u]) << (8u * (n - 1u)));
+}
+
+// block `b` of a key, 0 once the key has no more blocks.
+template <typename Key>
+inline uint64_t murmur64a_block(const Key& key, size_t b) {
+    uint64_t block = 0u;
+    if (b < key.size / 8u) {
+        memcpy(&block, key.data + 8u * b, 8u);
+    }
+    return block;
+}
+
+// Groups of keys shorter than this on average are hashed one by one: with
+// no more than a block per key the lanes only save multiplies, which the
+// scalar loads filling them cost again. Longer keys of mixed lengths, where
+// the scalar loop mispredicts its block count and tail, gain about a third.
+const size_t MURMUR64A_LANE_MIN_SIZE = 16u;
+
+template <typename Key>
+inline bool murmur64a_short_keys(const Key* keys, size_t count) {
+    size_t bytes = 0u;
+    for (size_t i = 0u; i < count; ++i) {
+        bytes += keys[i].size;
+    }
+    return bytes < count * MURMUR64A_LANE_MIN_SIZE;
+}
+
+template <typename Key>
+void murmur64a_batch_scalar(const Key* keys, size_t count, unsigned int seed, uint64_t* out) {
+    for (size_t i = 0u; i < count; ++i) {
+        out[i] = MurmurHash64A(keys[i].data, static_cast<int>(keys[i].size), seed);
+    }
+}
+
+#ifdef DATA_CLEANER_X86
+// AVX2 has no 64 bit multiply, the low word is put together from three
+// 32 x 32 bit products.
+__attribute__((target("avx2")))
+inline __m256i murmur64a_mul_avx2(__m256i a, __m256i m, __m256i m_hi) {
+    __m256i lo = _mm256_mul_epu32(a, m);
+    __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), m),
+            _mm256_mul_epu32(a, m_hi));
+    return _mm256_add_epi64(lo, _mm256_slli_epi64(cross, 32));
+}
+
+template <typename Key>
+__attribute__((target("avx2")))
+void murmur64a_x4_avx2(const Key* keys, unsigned int seed, uint64_t* out) {
+    const __m256i m = _mm256_set1_epi64x(MURMUR64A_M);
+    const __m256i m_hi = _mm256_srli_epi64(m, 32);
+    size_t max_blocks = 0u;
+    for (size_t i = 0u; i < 4u; ++i) {
+        max_blocks = max_blocks > keys[i].size / 8u ? max_blocks : keys[i].size / 8u;
+    }
+    __m256i size = _mm256_set_epi64x(keys[3].size, keys[2].size, keys[1].size, keys[0].size);
+    __m256i tail = _mm256_set_epi64x(murmur64a_tail(keys[3].data, keys[3].size),
+            murmur64a_tail(keys[2].data, keys[2].size), murmur64a_tail(keys[1].data, keys[1].size),
+            murmur64a_tail(keys[0].data, keys[0].size));
+    __m256i blocks = _mm256_srli_epi64(size, 3);
+    __m256i h = _mm256_xor_si256(_mm256_set1_epi64x(seed), murmur64a_mul_avx2(size, m, m_hi));
+    for (size_t b = 0u; b < max_blocks; ++b) {
+        __m256i active = _mm256_cmpgt_epi64(blocks, _mm256_set1_epi64x(b));
+        __m256i k = _mm256_set_epi64x(murmur64a_block(keys[3], b), murmur64a_block(keys[2], b),
+                murmur64a_block(keys[1], b), murmur64a_block(keys[0], b));
+        k = murmur64a_mul_avx2(k, m, m_hi);
+        k = _mm256_xor_si256(k, _mm256_srli_epi64(k, 47));
+        k = murmur64a_mul_avx2(k, m, m_hi);
+        __m256i next = murmur64a_mul_avx2(_mm256_xor_si256(h, k), m, m_hi);
+        h = _mm256_blendv_epi8(h, next, active);
+    }
+    __m256i has_tail = _mm256_cmpgt_epi64(_mm256_and_si256(size, _mm256_set1_epi64x(7)),
+            _mm256_setzero_si256());
+    h = _mm256_blendv_epi8(h, murmur64a_mul_avx2(_mm256_xor_si256(h, tail), m, m_hi), has_tail);
+    h = _mm256_xor_si256(h, _mm256_srli_epi64(h, 47));
+    h = murmur64a_mul_avx2(h, m, m_hi);
+    h = _mm256_xor_si256(h, _mm256_srli_epi64(h, 47));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), h);
+}
+
+template <typename Key>
+__attribute__((target("avx2")))
+void murmur64a_batch_avx2(const Key* keys, size_t count, unsigned int seed, uint64_t* out) {
+    size_t i = 0u;
+    for (; i + 4u <= count; i += 4u) {
+        if (murmur64a_short_keys(keys + i, 4u)) {
+            murmur64a_batch_scalar(keys + i, 4u, seed, out + i);
+        } else {
+            murmur64a_x4_avx2(keys + i, seed, out + i);
+        }
+    }
+    murmur64a_batch_scalar(keys + i, count - i, seed, out + i);
+}
+
+// The maskz_ forms of the shifts avoid GCC's uninitialized merge operand.
+template <typename Key>
+__attribute__((target("avx512f,avx512dq")))
+void murmur64a_x8_avx512(const Key* keys, unsigned int seed, uint64_t* out) {
+    const __m512i m = _mm512_set1_epi64(MURMUR64A_M);
+    size_t max_blocks = 0u;
+    for (size_t i = 0u; i < 8u; ++i) {
+        max_blocks = max_blocks > keys[i].size / 8u ? max_blocks : keys[i].size / 8u;
+    }
+    __m512i size = _mm512_set_epi64(keys[7].size, keys[6].size, keys[5].size, keys[4].size,
+            keys[3].size, keys[2].size, keys[1].size, keys[0].size);
+    __m512i tail = _mm512_set_epi64(murmur64a_tail(keys[7].data, keys[7].size),
+            murmur64a_tail(keys[6].data, keys[6].size), murmur64a_tail(keys[5].data, keys[5].size),
+            murmur64a_tail(keys[4].data, keys[4].size), murmur64a_tail(keys[3].data, keys[3].size),
+            murmur64a_tail(keys[2].data, keys[2].size), murmur64a_tail(keys[1].data, keys[1].size),
+            murmur64a_tail(keys[0].data, keys[0].size));
+    __m512i blocks = _mm512_maskz_srli_epi64(0xff, size, 3);
+    __m512i h = _mm512_xor_si512(_mm512_set1_epi64(seed), _mm512_mullo_epi64(size, m));
+    for (size_t b = 0u; b < max_blocks; ++b) {
+        __mmask8 active = _mm512_cmpgt_epu64_mask(blocks, _mm512_set1_epi64(b));
+        __m512i k = _mm512_set_epi64(murmur64a_block(keys[7], b), murmur64a_block(keys[6], b),
+                murmur64a_block(keys[5], b), murmur64a_block(keys[4], b),
+                murmur64a_block(keys[3], b), murmur64a_block(keys[2], b),
+                murmur64a_block(keys[1], b), murmur64a_block(keys[0], b));
+        k = _mm512_mullo_epi64(k, m);
+        k = _mm512_xor_si512(k, _mm512_maskz_srli_epi64(0xff, k, 47));
+        k = _mm512_mullo_epi64(k, m);
+        h = _mm512_mask_mullo_epi64(h, active, _mm512_xor_si512(h, k), m);
+    }
+    __mmask8 has_tail = _mm512_test_epi64_mask(size, _mm512_set1_epi64(7));
+    h = _mm512_mask_mullo_epi64(h, has_tail, _mm512_xor_si512(h, tail), m);
+    h = _mm512_xor_si512(h, _mm512_maskz_srli_epi64(0xff, h, 47));
+    h = _mm512_mullo_epi64(h, m);
+    h = _mm512_xor_si512(h, _mm512_maskz_srli_epi64(0xff, h, 47));
+    _mm512_storeu_si512(out, h);
+}
+
+template <typename Key>
+__attribute__((target("avx512f,avx512dq")))
+void murmur64a_batch_avx512(const Key* keys, size_t count, unsigned int seed, uint64_t* out) {
+    size_t i = 0u;
+    for (; i + 8u <= count; i += 8u) {
+        if (murmur64a_short_keys(keys + i, 8u)) {
+            murmur64a_batch_scalar(keys + i, 8u, seed, out + i);
+        } else {
+            murmur64a_x8_avx512(keys + i, seed, out + i);
+        }
+    }
+    murmur64a_batch_scalar(keys + i, count - i, seed, out + i);
+}
+#endif
+
+template <typename Key>
+using MurmurBatchFn = void (*)(const Key* keys, size_t count, unsigned int seed, uint64_t* out);
+
+// Picks the widest kernel the CPU supports, once per process and key type.
+template <typename Key>
+MurmurBatchFn<Key> select_murmur64a_batch() {
+#ifdef DATA_CLEANER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq")) {
+        return murmur64a_batch_avx512<Key>;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return murmur64a_batch_avx2<Key>;
+    }
+#endif
+    return murmur64a_batch_scalar<Key>;
+}
+
+template <typename Key>
+void MurmurHash64A_batch(const Key* keys, size_t count, unsigned int seed, uint64_t* out) {
+    static const MurmurBatchFn<Key> fn = select_murmur64a_batch<Key>();
+    fn(keys, count, seed, out);
+}
+
+// The next word of the splitmix64 generator at `state`: one well mixed 64
+// bit word per step, for bits derived from a hash and for cheap per worker
+// random numbers.
+inline uint64_t splitmix64(uint64_t& state) {
+    uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+#endif // DATA_CLEANER_MURMURHASH3_H
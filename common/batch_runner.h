@@ -0,0 +1,299 @@
+#ifndef DATA_CLEANER_BATCH_RUNNER_H
+#define DATA_CLEANER_BATCH_RUNNER_H
+
+#include <glob.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "chunk_pipeline.h"
+#include "cli_options.h"
+#include "column_plan.h"
+#include "compression.h"
+#include "file_line_reader.h"
+#include "input_stream.h"
+#include "mapped_file.h"
+#include "output_sinks.h"
+#include "str_view.h"
+
+// One input file of a batch and the shards written for it.
+struct BatchFile {
+    std::string input;
+    std::string instances;
+    std::string labels;
+    uint64_t size = 0u;
+    // rows written to the shards and lines read, which --dedup and sampling
+    // tell apart.
+    uint64_t rows = 0u;
+    uint64_t input_rows = 0u;
+    int status = 0;
+};
+
+// Expands --batch: "@FILE" is a list with one path per line, anything else
+// a glob(3) pattern.
+inline int list_batch_inputs(const char* spec, std::vector<std::string>& inputs) {
+    if (spec[0] == '@') {
+        FILE* file = fopen(spec + 1, "r");
+        if (file == nullptr) {
+            std::cerr << "Open batch list [" << spec + 1 << "] failed." << std::endl;
+            return -1;
+        }
+        FileLineReader reader;
+        char* line = nullptr;
+        while (line = reader.getline(file)) {
+            if (reader.size() > 0u) {
+                inputs.push_back(std::string(line, reader.size()));
+            }
+        }
+        fclose(file);
+    } else {
+        glob_t matches;
+        int ret = glob(spec, 0, nullptr, &matches);
+        if (ret != 0 && ret != GLOB_NOMATCH) {
+            std::cerr << "glob [" << spec << "] failed." << std::endl;
+            return -1;
+        }
+        for (size_t i = 0u; i < matches.gl_pathc; ++i) {
+            inputs.push_back(matches.gl_pathv[i]);
+        }
+        globfree(&matches);
+    }
+    if (inputs.empty()) {
+        std::cerr << "no input files for batch [" << spec << "]" << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+// Shards are named after the input file: DIR/NAME.instance and DIR/NAME.label,
+// where NAME is the file name without a .gz/.zst suffix, plus the suffix of
+// the output compression.
+inline int plan_batch_files(const std::vector<std::string>& inputs, const char* output_dir,
+        Compression compression, std::vector<BatchFile>& files) {
+    const char* suffix = compression == COMPRESS_GZIP ? ".gz" :
+        compression == COMPRESS_ZSTD ? ".zst" : "";
+    std::set<std::string> names;
+    for (const auto& input : inputs) {
+        BatchFile file;
+        file.input = input;
+        struct stat st;
+        if (stat(input.c_str(), &st) != 0) {
+            std::cerr << "stat input file [" << input << "] failed." << std::endl;
+            return -1;
+        }
+        file.size = st.st_size;
+        std::string name = input.substr(input.rfind('/') + 1u);
+        for (const char* ext : {".gz", ".zst"}) {
+            size_t len = strlen(ext);
+            if (name.size() > len && name.compare(name.size() - len, len, ext) == 0) {
+                name.resize(name.size() - len);
+            }
+        }
+        if (!names.insert(name).second) {
+            std::cerr << "batch inputs share the file name [" << name << "]" << std::endl;
+            return -1;
+        }
+        std::string base = std::string(output_dir) + "/" + name;
+        file.instances = base + ".instance" + suffix;
+        file.labels = base + ".label" + suffix;
+        files.push_back(file);
+    }
+    return 0;
+}
+
+// Hands out task indices to workers. Every worker owns a deque, takes its
+// own tasks from the front and, once that is empty, steals from the back of
+// the others. Tasks are dealt largest first, so the big files start early
+// and the small ones fill in around them.
+class WorkStealingScheduler {
+public:
+    WorkStealingScheduler(size_t workers, const std::vector<size_t>& order)
+        : _queues(workers) {
+        for (size_t i = 0u; i < order.size(); ++i) {
+            _queues[i % workers].tasks.push_back(order[i]);
+        }
+    }
+
+    bool next(size_t worker, size_t& task) {
+        for (size_t k = 0u; k < _queues.size(); ++k) {
+            Queue& queue = _queues[(worker + k) % _queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.tasks.empty()) {
+                continue;
+            }
+            if (k == 0u) {
+                task = queue.tasks.front();
+                queue.tasks.pop_front();
+            } else {
+                task = queue.tasks.back();
+                queue.tasks.pop_back();
+            }
+            return true;
+        }
+        return false;
+    }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+    };
+
+    std::vector<Queue> _queues;
+};
+
+// Cleans one file into its shards. Diagnostics go to the shared sinks of
+// the run, one buffer at a time under `diag_mutex`.
+inline int clean_batch_file(const ColumnPlan& plan, ThreadContext& thread, BatchFile& file,
+        Compression compression, int level, OutputSinks& shared, std::mutex& diag_mutex) {
+    OutputSinks shard;
+    if (shard.open(file.instances.c_str(), file.labels.c_str(), nullptr, compression,
+            level) != 0) {
+        return -1;
+    }
+    const size_t FLUSH_SIZE = 1u << 20;
+    SinkBuffers output(false, FLUSH_SIZE * 2u);
+    if (plan.format == OUTPUT_BINARY) {
+        output.instances << encode_row_header(plan.slots, plan.row_flags());
+    }
+    // a failed write fails the file, whose shard is then incomplete.
+    int ret = 0;
+    auto flush = [&](size_t min_size) {
+        if (output.instances.size() >= min_size && shard.write_instances(output.instances) != 0) {
+            ret = -1;
+        }
+        if (output.labels.size() >= min_size && shard.write_labels(output.labels) != 0) {
+            ret = -1;
+        }
+        if (output.diagnostics.size() > 0u && output.diagnostics.size() >= min_size) {
+            std::lock_guard<std::mutex> lock(diag_mutex);
+            if (shared.write_diagnostics(output.diagnostics) != 0) {
+                ret = -1;
+            }
+        }
+    };
+    // after a failed write the rest of the file is only skipped over.
+    auto clean = [&](StrView line) {
+        if (ret != 0) {
+            return;
+        }
+        file.rows += clean_line(plan, line, thread, output);
+        ++file.input_rows;
+        flush(FLUSH_SIZE);
+    };
+
+    MappedFile input;
+    if (input.open(file.input.c_str()) != 0) {
+        return -1;
+    }
+    Compression input_compression = detect_compression(input.data(), input.size());
+    if (input_compression == COMPRESS_NONE) {
+        for_each_record(input.data(), input.size(), plan.quoted, clean);
+    } else {
+        InputStream stream;
+        if (stream.open_compressed(input_compression,
+                RawInput(input.data(), input.size())) != 0) {
+            return -1;
+        }
+        FileLineReader reader;
+        char* line = nullptr;
+        while (ret == 0 && (line = reader.getline(stream.stream(), plan.quoted))) {
+            clean({line, reader.size()});
+        }
+        if (stream.close() != 0) {
+            ret = -1;
+        }
+    }
+    flush(0u);
+    if (shard.close() != 0) {
+        ret = -1;
+    }
+    return ret;
+}
+
+// Writes `path` through a temporary file, one line per shard.
+inline int write_batch_manifest(const std::string& path, const std::vector<BatchFile>& files) {
+    std::string tmp = path + ".tmp";
+    FILE* file = fopen(tmp.c_str(), "w");
+    if (file == nullptr) {
+        std::cerr << "Open manifest [" << tmp << "] failed." << std::endl;
+        return -1;
+    }
+    bool ok = fprintf(file, "input\tinstances\tlabels\trows\tinput_rows\tstatus\n") > 0;
+    for (const auto& f : files) {
+        ok = ok && fprintf(file, "%s\t%s\t%s\t%llu\t%llu\t%s\n", f.input.c_str(),
+                f.instances.c_str(), f.labels.c_str(), static_cast<unsigned long long>(f.rows),
+                static_cast<unsigned long long>(f.input_rows),
+                f.status == 0 ? "ok" : "failed") > 0;
+    }
+    ok = (fclose(file) == 0) && ok;
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+        std::cerr << "write manifest [" << path << "] failed." << std::endl;
+        remove(tmp.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+// --batch: every input file is cleaned on its own by one of options.threads
+// workers into shards in options.output_dir, then the manifest is written.
+inline int run_batch(const CliOptions& options, const ColumnPlan& plan,
+        DiagnosticCounters& counters, Compression compression, int level,
+        OutputSinks& shared) {
+    std::vector<std::string> inputs;
+    std::vector<BatchFile> files;
+    if (list_batch_inputs(options.batch, inputs) != 0 ||
+            plan_batch_files(inputs, options.output_dir, compression, files) != 0) {
+        return -1;
+    }
+    std::vector<size_t> order(files.size());
+    for (size_t i = 0u; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&files](size_t a, size_t b) {
+        return files[a].size > files[b].size;
+    });
+
+    size_t workers = std::min(options.threads, files.size());
+    WorkStealingScheduler scheduler(workers, order);
+    std::mutex diag_mutex;
+    ThreadContext prototype(plan, counters);
+    std::vector<std::thread> threads;
+    for (size_t w = 0u; w < workers; ++w) {
+        threads.emplace_back([&, w] {
+            ThreadContext thread(prototype);
+            size_t task = 0u;
+            while (scheduler.next(w, task)) {
+                files[task].status = clean_batch_file(plan, thread, files[task], compression,
+                        level, shared, diag_mutex);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    int ret = 0;
+    for (const auto& file : files) {
+        if (file.status != 0) {
+            std::cerr << "batch input [" << file.input << "] failed." << std::endl;
+            ret = -1;
+        }
+    }
+    std::string manifest = options.manifest != nullptr ? options.manifest :
+        std::string(options.output_dir) + "/manifest.tsv";
+    if (write_batch_manifest(manifest, files) != 0) {
+        ret = -1;
+    }
+    return ret;
+}
+
+#endif // DATA_CLEANER_BATCH_RUNNER_H
@@ -0,0 +1,177 @@
+#ifndef DATA_CLEANER_BUCKET_FIT_H
+#define DATA_CLEANER_BUCKET_FIT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "column_plan.h"
+#include "file_line_reader.h"
+#include "output_buffer.h"
+#include "quantile_sketch.h"
+#include "str_view.h"
+#include "tokenizer.h"
+
+// Boundaries files hold one line per Numerical#Bucket column,
+// "INDEX\tB1,B2,...", as written by --fit-buckets and read by --buckets.
+inline int load_bucket_bounds(const char* path, ColumnPlan& plan) {
+    FILE* file = fopen(path, "r");
+    if (file == nullptr) {
+        std::cerr << "Open buckets file [" << path << "] failed." << std::endl;
+        return -1;
+    }
+    std::vector<bool> loaded(plan.columns.size(), false);
+    FileLineReader reader;
+    char* line = nullptr;
+    while (line = reader.getline(file)) {
+        auto fields = split({line, reader.size()}, '\t');
+        size_t index = 0u;
+        if (fields.size() != 2 || !parse_count(fields[0], index) ||
+                index >= plan.columns.size() || plan.columns[index].oflag != Oflag::NUM_BUCKET) {
+            std::cerr << "buckets file [" << path << "] does not match the schema: ["
+                      << StrView{line, reader.size()} << "]" << std::endl;
+            fclose(file);
+            return -1;
+        }
+        // bucket_index takes the bounds to be finite and strictly ascending.
+        std::vector<double> bounds;
+        if (fields[1].size > 0u) {
+            for (const auto& field : split(fields[1], ',')) {
+                double value = 0.0;
+                if (!parse_number(field, value) || !std::isfinite(value) ||
+                        (!bounds.empty() && !(bounds.back() < value))) {
+                    std::cerr << "invalid boundaries in buckets file [" << path << "]: ["
+                              << StrView{line, reader.size()} << "]" << std::endl;
+                    fclose(file);
+                    return -1;
+                }
+                bounds.push_back(value);
+            }
+        }
+        set_bucket_bounds(plan.columns[index], std::move(bounds));
+        loaded[index] = true;
+    }
+    fclose(file);
+    for (const auto& column : plan.columns) {
+        if (column.oflag == Oflag::NUM_BUCKET && !loaded[column.index]) {
+            std::cerr << "no boundaries for Numerical#Bucket column " << column.index
+                      << " in [" << path << "]" << std::endl;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+inline int save_bucket_bounds(const char* path, const ColumnPlan& plan) {
+    std::string tmp = std::string(path) + ".tmp";
+    FILE* file = fopen(tmp.c_str(), "w");
+    if (file == nullptr) {
+        std::cerr << "Open buckets file [" << tmp << "] failed." << std::endl;
+        return -1;
+    }
+    bool ok = true;
+    for (const auto& column : plan.columns) {
+        if (column.oflag != Oflag::NUM_BUCKET) {
+            continue;
+        }
+        ok = ok && fprintf(file, "%zu\t", column.index) > 0;
+        for (size_t i = 0u; i < column.bucket_bounds.size(); ++i) {
+            char buf[32];
+            size_t size = format_double(column.bucket_bounds[i], buf);
+            ok = ok && (i == 0u || fputc(',', file) != EOF) &&
+                 fwrite(buf, 1, size, file) == size;
+        }
+        ok = ok && fputc('\n', file) != EOF;
+    }
+    ok = (fclose(file) == 0) && ok;
+    if (!ok || rename(tmp.c_str(), path) != 0) {
+        std::cerr << "write buckets file [" << path << "] failed." << std::endl;
+        remove(tmp.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+// The sketches of the fitting pass: every worker fills a set of its own,
+// one per Numerical#Bucket column, and they are merged at the end.
+class BucketFitter {
+public:
+    explicit BucketFitter(const ColumnPlan& plan) {
+        for (const auto& column : plan.columns) {
+            if (column.oflag == Oflag::NUM_BUCKET) {
+                _columns.push_back(column.index);
+            }
+        }
+    }
+
+    const std::vector<size_t>& columns() const {
+        return _columns;
+    }
+
+    std::vector<QuantileSketch>* add_thread() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _threads.emplace_back(new std::vector<QuantileSketch>(_columns.size()));
+        return _threads.back().get();
+    }
+
+    // merges the sketches of all workers into the boundaries of the plan.
+    void fit(ColumnPlan& plan) {
+        for (size_t i = 0u; i < _columns.size(); ++i) {
+            QuantileSketch merged;
+            for (const auto& thread : _threads) {
+                merged.merge((*thread)[i]);
+            }
+            Column& column = plan.columns[_columns[i]];
+            set_bucket_bounds(column, merged.boundaries(column.buckets));
+        }
+    }
+
+private:
+    std::vector<size_t> _columns;
+    std::mutex _mutex;
+    std::vector<std::unique_ptr<std::vector<QuantileSketch>>> _threads;
+};
+
+// One worker of the fitting pass; like ThreadContext every copy gets
+// sketches of its own. Null values are left out, as they are not bucketized,
+// and so is anything but a finite number: NaN has no place in the sort.
+struct BucketFitContext {
+    BucketFitContext(const ColumnPlan& plan, BucketFitter& fitter)
+        : tokenizer(plan.field_delim, std::vector<char>(), plan.quoted), plan(plan), fitter(fitter),
+          sketches(fitter.add_thread()) {
+        std::vector<bool> needed(plan.columns.size());
+        for (size_t column : fitter.columns()) {
+            needed[column] = true;
+        }
+        tokenizer.project(needed);
+    }
+
+    BucketFitContext(const BucketFitContext& other)
+        : tokenizer(other.tokenizer), plan(other.plan), fitter(other.fitter),
+          sketches(fitter.add_thread()) {}
+
+    void add_line(StrView line) {
+        const auto& tokens = tokenizer.split_line(line);
+        const auto& columns = fitter.columns();
+        for (size_t i = 0u; i < columns.size(); ++i) {
+            double value = 0.0;
+            if (columns[i] < tokens.size() &&
+                    !is_null(plan.columns[columns[i]], tokens[columns[i]]) &&
+                    parse_number(tokens[columns[i]], value) && std::isfinite(value)) {
+                (*sketches)[i].add(value);
+            }
+        }
+    }
+
+    Tokenizer tokenizer;
+    const ColumnPlan& plan;
+    BucketFitter& fitter;
+    std::vector<QuantileSketch>* sketches;
+};
+
+#endif // DATA_CLEANER_BUCKET_FIT_H
@@ -0,0 +1,377 @@
+#ifndef DATA_CLEANER_CHUNK_PIPELINE_H
+#define DATA_CLEANER_CHUNK_PIPELINE_H
+
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "output_buffer.h"
+#include "output_sinks.h"
+#include "str_view.h"
+#include "tokenizer.h"
+
+// Calls `f(StrView line)` for every '\n' terminated line in [data, data+size)
+// and for a trailing unterminated one if it is not empty.
+template <typename LineFn>
+void for_each_line(const char* data, size_t size, LineFn f) {
+    const char* line = data;
+    const char* end = data + size;
+    while (line < end) {
+        const char* newline = static_cast<const char*>(memchr(line, '\n', end - line));
+        if (newline == nullptr) {
+            newline = end;
+        }
+        f(StrView{line, static_cast<size_t>(newline - line)});
+        line = newline + 1;
+    }
+}
+
+// for_each_line for RFC 4180 input (`quoted`): newlines between double
+// quotes belong to the record, and a trailing '\r' is dropped.
+template <typename LineFn>
+void for_each_record(const char* data, size_t size, bool quoted, LineFn f) {
+    if (!quoted) {
+        for_each_line(data, size, f);
+        return;
+    }
+    const size_t BLOCK = 4096u;
+    uint32_t ends[BLOCK];
+    const ScanUnquotedFn scan = scan_unquoted();
+    auto emit = [&f](const char* begin, const char* end) {
+        if (end > begin && end[-1] == '\r') {
+            --end;
+        }
+        f(StrView{begin, static_cast<size_t>(end - begin)});
+    };
+    bool in_quotes = false;
+    const char* record = data;
+    for (size_t offset = 0u; offset < size; offset += BLOCK) {
+        const char* block = data + offset;
+        size_t n = scan(block, 0u, std::min(BLOCK, size - offset), '\n', in_quotes, ends);
+        for (size_t k = 0u; k < n; ++k) {
+            emit(record, block + ends[k]);
+            record = block + ends[k] + 1;
+        }
+    }
+    if (record < data + size) {
+        emit(record, data + size);
+    }
+}
+
+// One past the newline that ends the record data[from] is in, or `size`;
+// `in_quotes` is the quote state at `from`.
+inline size_t record_end(const char* data, size_t size, size_t from, bool in_quotes) {
+    const size_t BLOCK = 256u;
+    uint32_t ends[BLOCK];
+    for (; from < size; from += BLOCK) {
+        if (scan_unquoted()(data + from, 0u, std::min(BLOCK, size - from), '\n', in_quotes,
+                ends) != 0u) {
+            return from + ends[0] + 1u;
+        }
+    }
+    return size;
+}
+
+// The offset of the last newline in data[from, size) that ends a record,
+// npos if there is none; `data` starts at a record and `quotes` is the
+// number of quotes in data[0, from), updated to the whole of `data`, so a
+// buffer that grows is only scanned once. Between quotes or not is the
+// parity of the quotes before a byte.
+inline size_t last_record_end(const std::string& data, bool quoted, size_t from,
+        size_t& quotes) {
+    const char* begin = data.data() + from;
+    const char* newline = static_cast<const char*>(memrchr(begin, '\n', data.size() - from));
+    if (!quoted) {
+        return newline == nullptr ? std::string::npos : newline - data.data();
+    }
+    quotes += count_byte()(data.data(), from, data.size(), '"');
+    size_t before = quotes;
+    size_t counted = data.size();
+    while (newline != nullptr) {
+        size_t pos = newline - data.data();
+        before -= count_byte()(data.data(), pos, counted, '"');
+        counted = pos;
+        if (before % 2u == 0u) {
+            return pos;
+        }
+        newline = static_cast<const char*>(memrchr(begin, '\n', newline - begin));
+    }
+    return std::string::npos;
+}
+
+// A record aligned slice of the input together with the instance, label
+// and diagnostic output produced for it. `begin` points either into
+// `storage` (stream input) or into a mapped file.
+struct Chunk {
+    explicit Chunk(bool merged_sinks) : output(merged_sinks) {}
+
+    size_t seq = 0u;
+    const char* begin = nullptr;
+    size_t size = 0u;
+    size_t records = 0u;
+    std::string storage;
+    SinkBuffers output;
+};
+
+// Cuts the input into chunks of roughly `chunk_size` bytes at line boundaries,
+// record boundaries with `quoted` (see for_each_record), runs
+// `transform(StrView line, SinkBuffers& output)` over every line of a chunk on
+// `threads` workers and writes the buffers of each chunk to `sinks`. With
+// `ordered` the chunks are written in input order, so the output is byte
+// identical to the single threaded loop. Every worker runs its own copy of
+// `transform`, which may therefore carry per thread scratch state such as a
+// Tokenizer.
+template <typename LineTransform>
+class ChunkPipeline {
+public:
+    ChunkPipeline(size_t threads, bool ordered, size_t chunk_size, bool quoted,
+            OutputSinks& sinks, LineTransform transform)
+        : _threads(threads == 0u ? 1u : threads),
+          _ordered(ordered),
+          _chunk_size(chunk_size),
+          _quoted(quoted),
+          _max_inflight(_threads * 4u),
+          _sinks(sinks),
+          _transform(transform) {}
+
+    // stream input, copied into per chunk buffers.
+    int run(FILE* in) {
+        return run_with([this, in] { return read(in); });
+    }
+
+    // mapped input, chunks are ranges of the mapping.
+    int run(const char* data, size_t size) {
+        return run_with([this, data, size] { return cut(data, size); });
+    }
+
+    // Called on the writer thread with the input bytes and records of every
+    // chunk once its output is written; with `ordered` everything before
+    // them is written too. Not called after a write failed.
+    void on_written(std::function<void(size_t bytes, size_t records)> written) {
+        _written = std::move(written);
+    }
+
+private:
+    template <typename Producer>
+    int run_with(Producer produce) {
+        std::vector<std::thread> workers;
+        for (size_t i = 0u; i < _threads; ++i) {
+            workers.emplace_back(&ChunkPipeline::work, this);
+        }
+        std::thread writer(&ChunkPipeline::write, this);
+
+        int ret = produce();
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _reading_done = true;
+        }
+        _work_cv.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _working_done = true;
+        }
+        _done_cv.notify_all();
+        writer.join();
+        return _write_failed ? -1 : ret;
+    }
+
+    void submit(std::unique_ptr<Chunk> chunk) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _slot_cv.wait(lock, [this] { return _inflight < _max_inflight; });
+        ++_inflight;
+        _pending.push_back(std::move(chunk));
+        lock.unlock();
+        _work_cv.notify_one();
+    }
+
+    int cut(const char* data, size_t size) {
+        const char* end = data + size;
+        size_t seq = 0u;
+        while (data < end && !_write_failed) {
+            const char* stop = data + std::min(_chunk_size, static_cast<size_t>(end - data));
+            if (stop < end && _quoted) {
+                bool in_quotes = count_byte()(data, 0u, stop - data, '"') % 2u != 0u;
+                stop = data + record_end(data, end - data, stop - data, in_quotes);
+            } else if (stop < end) {
+                const char* newline =
+                    static_cast<const char*>(memchr(stop, '\n', end - stop));
+                stop = newline == nullptr ? end : newline + 1;
+            }
+            std::unique_ptr<Chunk> chunk(new Chunk(_sinks.merged()));
+            chunk->seq = seq++;
+            chunk->begin = data;
+            chunk->size = stop - data;
+            submit(std::move(chunk));
+            data = stop;
+        }
+        return 0;
+    }
+
+    int read(FILE* in) {
+        std::string carry;
+        size_t seq = 0u;
+        bool eof = false;
+        while (!eof && !_write_failed) {
+            std::unique_ptr<Chunk> chunk(new Chunk(_sinks.merged()));
+            std::string& data = chunk->storage;
+            data.swap(carry);
+            size_t last_newline = std::string::npos;
+            size_t scanned = 0u;
+            size_t quotes = 0u;
+            // grow until the chunk holds at least one complete record.
+            while (last_newline == std::string::npos && !eof) {
+                size_t offset = data.size();
+                data.resize(offset + _chunk_size);
+                size_t n = fread(&data[offset], 1, _chunk_size, in);
+                data.resize(offset + n);
+                if (n < _chunk_size) {
+                    if (ferror(in)) {
+                        std::cerr << "read input failed." << std::endl;
+                        return -1;
+                    }
+                    eof = true;
+                }
+                last_newline = last_record_end(data, _quoted, scanned, quotes);
+                scanned = data.size();
+            }
+            if (!eof) {
+                carry.assign(data, last_newline + 1, std::string::npos);
+                data.resize(last_newline + 1);
+            }
+            if (data.empty()) {
+                break;
+            }
+            chunk->seq = seq++;
+            chunk->begin = data.data();
+            chunk->size = data.size();
+            submit(std::move(chunk));
+        }
+        return 0;
+    }
+
+    void work() {
+        LineTransform transform(_transform);
+        while (true) {
+            std::unique_ptr<Chunk> chunk;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _work_cv.wait(lock, [this] { return !_pending.empty() || _reading_done; });
+                if (_pending.empty()) {
+                    return;
+                }
+                chunk = std::move(_pending.front());
+                _pending.pop_front();
+            }
+            process(*chunk, transform);
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _finished.insert(std::make_pair(chunk->seq, std::move(chunk)));
+            }
+            _done_cv.notify_one();
+        }
+    }
+
+    void process(Chunk& chunk, LineTransform& transform) {
+        SinkBuffers& output = chunk.output;
+        size_t records = 0u;
+        for_each_record(chunk.begin, chunk.size, _quoted,
+                [&transform, &output, &records](StrView line) {
+            transform(line, output);
+            ++records;
+        });
+        chunk.records = records;
+        std::string().swap(chunk.storage);
+    }
+
+    void write() {
+        size_t next_seq = 0u;
+        while (true) {
+            std::unique_ptr<Chunk> chunk;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _done_cv.wait(lock, [this, next_seq] {
+                    return _working_done ||
+                           (!_finished.empty() &&
+                            (!_ordered || _finished.begin()->first == next_seq));
+                });
+                if (_finished.empty()) {
+                    return;
+                }
+                auto it = _ordered ? _finished.find(next_seq) : _finished.begin();
+                if (it == _finished.end()) {
+                    // only reachable after an aborted read left a gap.
+                    it = _finished.begin();
+                }
+                chunk = std::move(it->second);
+                _finished.erase(it);
+            }
+            next_seq = chunk->seq + 1u;
+            // after a failed write the rest is dropped, not written with a
+            // gap before it; reading stops.
+            if (!_write_failed && chunk->output.flush_to(_sinks) != 0) {
+                _write_failed = true;
+            }
+            if (_written && !_write_failed) {
+                _written(chunk->size, chunk->records);
+            }
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                --_inflight;
+            }
+            _slot_cv.notify_one();
+        }
+    }
+
+    const size_t _threads;
+    const bool _ordered;
+    const size_t _chunk_size;
+    const bool _quoted;
+    const size_t _max_inflight;
+    OutputSinks& _sinks;
+    LineTransform _transform;
+    std::function<void(size_t, size_t)> _written;
+
+    std::mutex _mutex;
+    std::condition_variable _work_cv;
+    std::condition_variable _done_cv;
+    std::condition_variable _slot_cv;
+    std::deque<std::unique_ptr<Chunk>> _pending;
+    std::map<size_t, std::unique_ptr<Chunk>> _finished;
+    size_t _inflight = 0u;
+    bool _reading_done = false;
+    bool _working_done = false;
+    std::atomic<bool> _write_failed{false};
+};
+
+template <typename LineTransform>
+int run_chunk_pipeline(FILE* in, size_t threads, bool ordered, size_t chunk_size, bool quoted,
+        OutputSinks& sinks, LineTransform transform) {
+    ChunkPipeline<LineTransform> pipeline(threads, ordered, chunk_size, quoted, sinks,
+            transform);
+    return pipeline.run(in);
+}
+
+template <typename LineTransform>
+int run_chunk_pipeline(const char* data, size_t size, size_t threads, bool ordered,
+        size_t chunk_size, bool quoted, OutputSinks& sinks, LineTransform transform) {
+    ChunkPipeline<LineTransform> pipeline(threads, ordered, chunk_size, quoted, sinks,
+            transform);
+    return pipeline.run(data, size);
+}
+
+#endif // DATA_CLEANER_CHUNK_PIPELINE_H
@@ -0,0 +1,448 @@
+#ifndef DATA_CLEANER_CLEANER_MAIN_H
+#define DATA_CLEANER_CLEANER_MAIN_H
+
+#include <stdio.h>
+#include <unistd.h>
+#include <iostream>
+#include <memory>
+
+#include "batch_runner.h"
+#include "bucket_fit.h"
+#include "chunk_pipeline.h"
+#include "cli_options.h"
+#include "column_plan.h"
+#include "column_profile.h"
+#include "compression.h"
+#include "diagnostics.h"
+#include "file_line_reader.h"
+#include "input_stream.h"
+#include "mapped_file.h"
+#include "output_buffer.h"
+#include "output_sinks.h"
+#include "row_dedup.h"
+#include "row_format.h"
+#include "row_sampler.h"
+#include "run_stats.h"
+#include "str_view.h"
+#include "tokenizer.h"
+#include "tracked_input.h"
+#include "vocabulary.h"
+
+// Loads --vocab and hooks a vocabulary column into every categorical column
+// of the plan when --vocab or --vocab-out is given.
+inline int setup_vocabulary(const CliOptions& options, ColumnPlan& plan,
+        Vocabulary& vocabulary) {
+    if (options.vocab == nullptr && options.vocab_out == nullptr) {
+        if (options.vocab_unseen != nullptr) {
+            std::cerr << "--vocab-unseen needs --vocab or --vocab-out." << std::endl;
+            return -1;
+        }
+        return 0;
+    }
+    VocabPolicy policy = options.vocab_out != nullptr ? VOCAB_GROW : VOCAB_OOV;
+    if (options.vocab_unseen != nullptr && parse_vocab_policy(options.vocab_unseen, policy) != 0) {
+        std::cerr << "unknown --vocab-unseen [" << options.vocab_unseen << "]" << std::endl;
+        return -1;
+    }
+    if (policy == VOCAB_GROW && options.vocab_out == nullptr) {
+        std::cerr << "--vocab-unseen grow needs --vocab-out." << std::endl;
+        return -1;
+    }
+    if (options.vocab != nullptr && vocabulary.load(options.vocab, plan.columns.size()) != 0) {
+        return -1;
+    }
+    for (auto& column : plan.columns) {
+        if (column.oflag == CAT || column.oflag == MULTI_CAT || column.oflag == MULTI_CAT_NUM) {
+            column.vocab = &vocabulary.add_column(column.index, policy);
+        }
+    }
+    return 0;
+}
+
+// Runs `transform(StrView line, SinkBuffers& output)` over every input
+// line (every record with --csv), on options.threads workers, and writes the
+// buffers to `sinks`; -1 if reading or writing failed.
+template <typename LineTransform>
+int run_input(const CliOptions& options, OutputSinks& sinks, LineTransform transform) {
+    // the single threaded paths write through one set of buffers, each
+    // flushed whenever it holds FLUSH_SIZE bytes.
+    const size_t FLUSH_SIZE = 1u << 20;
+    SinkBuffers output(sinks.merged(), FLUSH_SIZE * 2u);
+    auto write_line = [&](StrView line) {
+        transform(line, output);
+        return output.flush_to(sinks, FLUSH_SIZE) == 0;
+    };
+    MappedFile input;
+    InputStream stream;
+    if (options.input != nullptr) {
+        if (input.open(options.input) != 0) {
+            return -1;
+        }
+        Compression compression = detect_compression(input.data(), input.size());
+        if (compression == COMPRESS_NONE) {
+            if (options.threads > 1u) {
+                return run_chunk_pipeline(input.data(), input.size(), options.threads,
+                        options.ordered, options.chunk_size, options.csv, sinks, transform);
+            }
+            for_each_record(input.data(), input.size(), options.csv, write_line);
+            output.flush_to(sinks);
+            return sinks.failed() ? -1 : 0;
+        }
+        if (stream.open_compressed(compression, RawInput(input.data(), input.size())) != 0) {
+            return -1;
+        }
+    } else if (stream.open_stdin() != 0) {
+        return -1;
+    }
+
+    int ret = 0;
+    if (options.threads > 1u) {
+        ret = run_chunk_pipeline(stream.stream(), options.threads, options.ordered,
+                options.chunk_size, options.csv, sinks, transform);
+    } else {
+        FileLineReader reader;
+        char* line = nullptr;
+        while (line = reader.getline(stream.stream(), options.csv)) {
+            if (!write_line({line, reader.size()})) {
+                break;
+            }
+        }
+        output.flush_to(sinks);
+    }
+    if (stream.close() != 0 || sinks.failed()) {
+        ret = -1;
+    }
+    return ret;
+}
+
+// run_input for --checkpoint and --follow: reads --input from the
+// checkpoint's offset through a TrackedInput and advances `checkpointer` by
+// what is written, saving it when due. Single threaded that is checked every
+// CHECK_LINES lines and before waiting for input; with --threads after every
+// chunk, so a followed file is only cleaned a --chunk-size at a time. Only
+// output that reached the sinks counts, the first failed write ends the run.
+template <typename LineTransform>
+int run_tracked_input(const CliOptions& options, OutputSinks& sinks, LineTransform transform,
+        Checkpointer& checkpointer) {
+    TrackedInput input;
+    if (input.open(options.input, checkpointer.offset(), options.follow) != 0) {
+        return -1;
+    }
+    int ret = 0;
+    if (options.threads > 1u) {
+        ChunkPipeline<LineTransform> pipeline(options.threads, true, options.chunk_size,
+                options.csv, sinks, transform);
+        pipeline.on_written([&checkpointer](size_t bytes, size_t records) {
+            checkpointer.advance(bytes, records);
+            if (checkpointer.due()) {
+                checkpointer.save();
+            }
+        });
+        ret = pipeline.run(input.stream());
+    } else {
+        const size_t FLUSH_SIZE = 1u << 20;
+        const uint64_t CHECK_LINES = 1024u;
+        SinkBuffers output(sinks.merged(), FLUSH_SIZE * 2u);
+        FileLineReader reader;
+        // bytes and rows cleaned since the last commit; the reader's count
+        // runs ahead of them inside a multi line record.
+        uint64_t consumed = 0u;
+        uint64_t rows = 0u;
+        uint64_t counted = 0u;
+        auto commit = [&] {
+            if (output.flush_to(sinks) != 0) {
+                return false;
+            }
+            checkpointer.advance(consumed, rows);
+            consumed = 0u;
+            rows = 0u;
+            return true;
+        };
+        input.on_idle([&] {
+            if (!commit()) {
+                return false;
+            }
+            if (checkpointer.due()) {
+                checkpointer.save();
+            }
+            return true;
+        });
+        char* line = nullptr;
+        while (line = reader.getline(input.stream(), options.csv)) {
+            transform({line, reader.size()}, output);
+            consumed += reader.consumed() - counted;
+            counted = reader.consumed();
+            if (output.flush_to(sinks, FLUSH_SIZE) != 0) {
+                break;
+            }
+            if (++rows % CHECK_LINES == 0u && checkpointer.due()) {
+                if (!commit()) {
+                    break;
+                }
+                checkpointer.save();
+            }
+        }
+        if (sinks.failed() || !commit()) {
+            ret = -1;
+        }
+    }
+    if (input.close() != 0) {
+        ret = -1;
+    }
+    return ret;
+}
+
+// Runs every input line through the plan; with a `checkpointer` through
+// run_tracked_input.
+inline int clean_input(const CliOptions& options, const ColumnPlan& plan,
+        OutputSinks& sinks, DiagnosticCounters& counters, Checkpointer* checkpointer = nullptr) {
+    ThreadContext thread(plan, counters);
+    auto clean = [&plan, thread](StrView line, SinkBuffers& output) mutable {
+        clean_line(plan, line, thread, output);
+    };
+    if (checkpointer != nullptr) {
+        return run_tracked_input(options, sinks, clean, *checkpointer);
+    }
+    return run_input(options, sinks, clean);
+}
+
+// The first pass of --fit-buckets: sketches every Numerical#Bucket column
+// over the whole input and installs the boundaries in the plan.
+inline int fit_buckets(const CliOptions& options, ColumnPlan& plan, OutputSinks& sinks) {
+    BucketFitter fitter(plan);
+    BucketFitContext context(plan, fitter);
+    int ret = run_input(options, sinks, [context](StrView line, SinkBuffers&) mutable {
+        context.add_line(line);
+    });
+    if (ret != 0) {
+        return -1;
+    }
+    fitter.fit(plan);
+    return save_bucket_bounds(options.fit_buckets, plan);
+}
+
+// --profile: profiles every column of the plan over the whole input in one
+// pass and writes the report; nothing is cleaned.
+inline int profile_input(const CliOptions& options, const ColumnPlan& plan,
+        OutputSinks& sinks, DiagnosticCounters& counters) {
+    Profiler profiler(plan);
+    ProfileContext context(profiler, counters);
+    int ret = run_input(options, sinks, [context](StrView line, SinkBuffers& output) mutable {
+        context.add_line(line, output);
+    });
+    if (ret != 0) {
+        return -1;
+    }
+    return profiler.write_file(options.profile);
+}
+
+// Numerical#Bucket columns need boundaries from --buckets or --fit-buckets.
+inline int check_bucket_options(const CliOptions& options, const ColumnPlan& plan) {
+    if (!plan.has_buckets()) {
+        if (options.buckets != nullptr || options.fit_buckets != nullptr) {
+            std::cerr << "--buckets and --fit-buckets need a Numerical#Bucket column." << std::endl;
+            return -1;
+        }
+        return 0;
+    }
+    if ((options.buckets == nullptr) == (options.fit_buckets == nullptr)) {
+        std::cerr << "Numerical#Bucket columns need either --buckets or --fit-buckets." << std::endl;
+        return -1;
+    }
+    if (options.fit_buckets != nullptr && options.batch != nullptr) {
+        std::cerr << "--fit-buckets cannot be combined with --batch, fit on one file and"
+                  << " pass --buckets." << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+// The whole command line program; the front ends only pick their dialect.
+inline int run_cleaner(int argc, char* argv[], const CleanerDialect& dialect) {
+    CliOptions options;
+    if (parse_cli_options(argc, argv, options) != 0) {
+        print_usage(argv[0]);
+        return -1;
+    }
+
+    ColumnPlan plan;
+    if (parse_output_format(options.format, plan.format) != 0) {
+        std::cerr << "unknown --format [" << options.format << "]" << std::endl;
+        return -1;
+    }
+    plan.hash_space = options.hash_space;
+    plan.catnum_weights = options.catnum_weights;
+    plan.label_first = options.label_first;
+    if (options.csv) {
+        plan.field_delim = ',';
+        plan.quoted = true;
+    }
+    if (parse_feature_flags(options.feature_flags, dialect, plan) != 0) {
+        std::cerr << "Parse feature flag file failed." << std::endl;
+        return -1;
+    }
+    Vocabulary vocabulary;
+    if (setup_vocabulary(options, plan, vocabulary) != 0) {
+        return -1;
+    }
+    if (options.profile != nullptr) {
+        if (options.batch != nullptr || options.fit_buckets != nullptr ||
+                options.vocab_out != nullptr || options.dedup != nullptr ||
+                options.sampling()) {
+            std::cerr << "--profile cannot be combined with --batch, --fit-buckets,"
+                      << " --vocab-out, --dedup or sampling." << std::endl;
+            return -1;
+        }
+    } else if (check_bucket_options(options, plan) != 0) {
+        return -1;
+    }
+    if (options.buckets != nullptr && load_bucket_bounds(options.buckets, plan) != 0) {
+        return -1;
+    }
+    // before the workers copy their ThreadContext, whose tokenizer projects
+    // onto the key columns too.
+    std::unique_ptr<RowDeduplicator> dedup;
+    if (options.dedup != nullptr) {
+        dedup.reset(new RowDeduplicator);
+        if (dedup->init(options.dedup, plan.columns.size(), options.dedup_capacity,
+                options.dedup_fp_rate) != 0) {
+            return -1;
+        }
+        plan.dedup = dedup.get();
+    }
+    std::unique_ptr<RowSampler> sampler;
+    if (options.sampling()) {
+        sampler.reset(new RowSampler);
+        if (sampler->init(options.sample, options.label_rates, options.sample_key,
+                options.reservoir, options.sample_seed, plan.columns.size(),
+                plan.label_column) != 0) {
+            return -1;
+        }
+        plan.sampler = sampler.get();
+        plan.sample_weight = options.sample_weight;
+        if (plan.sample_weight && plan.format == OUTPUT_BINARY) {
+            // one past the schema columns, like the text column.
+            plan.weight_slot = plan.slots.size();
+            plan.slots.push_back({static_cast<uint32_t>(plan.columns.size()), ROW_SLOT_DOUBLE,
+                    ROW_ROLE_VALUE, 0u});
+        }
+    }
+    DiagnosticCounters counters(options.max_diagnostics);
+    std::unique_ptr<RunStats> stats;
+    std::unique_ptr<StatsReporter> reporter;
+    if (options.stats != nullptr) {
+        stats.reset(new RunStats(stats_columns(plan)));
+        enable_column_stats(plan, *stats);
+        // before the sinks, which may start compression threads.
+        reporter.reset(new StatsReporter(*stats, counters, options.stats,
+                options.stats_interval));
+        if (reporter->start() != 0) {
+            return -1;
+        }
+    }
+
+    OutputSinks sinks;
+    Compression compression = COMPRESS_NONE;
+    if (parse_compression(options.compress, compression) != 0) {
+        std::cerr << "unknown --compress [" << options.compress << "]" << std::endl;
+        return -1;
+    }
+    int level = options.compress_level;
+    if (level == CliOptions::DEFAULT_LEVEL) {
+        level = compression == COMPRESS_GZIP ? Z_DEFAULT_COMPRESSION : 0;
+    }
+    int ret = 0;
+    if (options.profile != nullptr) {
+        // profiles take the raw values, boundaries and vocabularies are not
+        // needed; the sinks only take diagnostics.
+        if (sinks.open(nullptr, nullptr, options.diagnostics) != 0) {
+            return -1;
+        }
+        ret = profile_input(options, plan, sinks, counters);
+    } else if (options.batch != nullptr) {
+        // the shards are compressed, the run's own sinks only take diagnostics.
+        if (!compression_supported(compression) ||
+                sinks.open(nullptr, nullptr, options.diagnostics) != 0) {
+            return -1;
+        }
+        ret = run_batch(options, plan, counters, compression, level, sinks);
+    } else {
+        // --resume without a checkpoint yet starts from the beginning.
+        Checkpoint start;
+        bool resumed = options.resume && access(options.checkpoint, F_OK) == 0;
+        if (resumed && start.load(options.checkpoint) != 0) {
+            return -1;
+        }
+        if (resumed && start.input != options.input) {
+            std::cerr << "checkpoint [" << options.checkpoint << "] is of input ["
+                      << start.input << "]" << std::endl;
+            return -1;
+        }
+        if (options.input != nullptr) {
+            start.input = options.input;
+        }
+        if (sinks.open(options.instances, options.labels, options.diagnostics, compression,
+                level, resumed) != 0) {
+            return -1;
+        }
+        if (resumed && sinks.rewind(start.outputs) != 0) {
+            return -1;
+        }
+        // stdin cannot be read twice, so without --input fitting is all
+        // the run does.
+        bool clean = true;
+        if (options.fit_buckets != nullptr) {
+            ret = fit_buckets(options, plan, sinks);
+            clean = ret == 0 && options.input != nullptr;
+        }
+        if (clean && plan.format == OUTPUT_BINARY && !resumed) {
+            OutputBuffer header;
+            header << encode_row_header(plan.slots, plan.row_flags());
+            sinks.write_instances(header);
+        }
+        if (clean && (options.checkpoint != nullptr || options.follow)) {
+            Checkpointer checkpointer(options.checkpoint, options.checkpoint_interval, sinks,
+                    start);
+            ret = clean_input(options, plan, sinks, counters, &checkpointer);
+            // the last checkpoint covers everything written, also when
+            // reading failed part way; after a failed write it is not saved.
+            if (checkpointer.finish() != 0) {
+                ret = -1;
+            }
+        } else if (clean) {
+            ret = clean_input(options, plan, sinks, counters);
+        }
+        if (clean && ret == 0 && sampler && sampler->has_reservoir()) {
+            SinkBuffers held(false);
+            sampler->write_reservoir(held.instances, held.labels, plan.format == OUTPUT_BINARY);
+            held.flush_to(sinks);
+        }
+    }
+    OutputBuffer summary;
+    counters.write_summary(summary);
+    if (dedup) {
+        summary << "dropped " << dedup->dropped() << " duplicate rows\n";
+    }
+    if (sampler) {
+        summary << "sampled " << sampler->kept() << " of " << sampler->seen() << " rows\n";
+    }
+    sinks.write_diagnostics(summary);
+    if (sinks.close() != 0) {
+        ret = -1;
+    }
+    if (stats) {
+        reporter->stop();
+        if (stats->write_file(options.stats, counters, true) != 0) {
+            ret = -1;
+        }
+    }
+    if (ret != 0) {
+        return -1;
+    }
+    if (options.vocab_out != nullptr && vocabulary.save(options.vocab_out) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+#endif // DATA_CLEANER_CLEANER_MAIN_H
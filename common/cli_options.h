@@ -0,0 +1,328 @@
+#ifndef DATA_CLEANER_CLI_OPTIONS_H
+#define DATA_CLEANER_CLI_OPTIONS_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <thread>
+
+struct CliOptions {
+    const char* feature_flags = nullptr;
+    // read this file through mmap instead of stdin.
+    const char* input = nullptr;
+    // 1 keeps the original line-at-a-time loop, 0 means one worker per core.
+    size_t threads = 1u;
+    // write chunks in input order; --unordered writes them as they complete.
+    bool ordered = true;
+    size_t chunk_size = 4u << 20;
+    // RFC 4180 input: ',' separated fields, which may be double quoted and
+    // then hold ',', newlines and "" for a quote.
+    bool csv = false;
+    // dense ids for categorical columns: the vocabulary to map read only,
+    // where to save it at exit and what to do with unseen values
+    // (oov, sign or grow; grow is the default with --vocab-out).
+    const char* vocab = nullptr;
+    const char* vocab_out = nullptr;
+    const char* vocab_unseen = nullptr;
+    // instance output format: text, binary, libsvm or libffm.
+    const char* format = "text";
+    // libsvm/libffm feature indices are signs modulo hash_space.
+    size_t hash_space = 1u << 24;
+    bool catnum_weights = false;
+    // output files; instances default to stdout, labels and diagnostics to
+    // stderr. --label-first writes the label at the start of each text line.
+    const char* instances = nullptr;
+    const char* labels = nullptr;
+    const char* diagnostics = nullptr;
+    bool label_first = false;
+    // diagnostics written per kind, the rest are only counted.
+    uint64_t max_diagnostics = std::numeric_limits<uint64_t>::max();
+    // compression of the instances, and of the labels when --labels names a
+    // file: none, gzip or zstd. Compressed input is detected by itself.
+    static const int DEFAULT_LEVEL = std::numeric_limits<int>::min();
+    const char* compress = "none";
+    int compress_level = DEFAULT_LEVEL;
+    // batch mode: "@LIST" or a glob of input files, each cleaned into its
+    // own shards in output_dir; the manifest defaults to
+    // output_dir/manifest.tsv.
+    const char* batch = nullptr;
+    const char* output_dir = nullptr;
+    const char* manifest = nullptr;
+    // JSON run summary written at exit; with stats_interval > 0 it is also
+    // rewritten every that many seconds, and on SIGUSR1 in any case.
+    const char* stats = nullptr;
+    double stats_interval = 0.0;
+    // Numerical#Bucket boundaries: read from a file, or fitted over the
+    // input and written to one (then applied to --input in a second pass).
+    const char* buckets = nullptr;
+    const char* fit_buckets = nullptr;
+    // JSON column profile of the input, written instead of any instances.
+    const char* profile = nullptr;
+    // drop repeated rows: "row" keys on the whole line, "0,3" on those
+    // schema columns. The filter is sized for dedup_capacity distinct keys
+    // at a false positive rate of dedup_fp_rate.
+    const char* dedup = nullptr;
+    uint64_t dedup_capacity = 100000000u;
+    double dedup_fp_rate = 0.001;
+    // row sampling before any column is transformed: a rate for every row,
+    // "LABEL:RATE,..." rates by label, a column whose hash decides instead
+    // of a random number, the seed of both, and a reservoir of N rows
+    // written at the end. --sample-weight adds 1 / rate to every row.
+    double sample = 1.0;
+    const char* label_rates = nullptr;
+    const char* sample_key = nullptr;
+    uint64_t sample_seed = 0u;
+    size_t reservoir = 0u;
+    bool sample_weight = false;
+
+    // checkpoints of a run over --input: every checkpoint_interval seconds
+    // the input offset, rows and output offsets are saved to `checkpoint`,
+    // --resume continues from there. --follow keeps reading what is
+    // appended to --input until it is moved or removed, or SIGINT/SIGTERM.
+    const char* checkpoint = nullptr;
+    double checkpoint_interval = 60.0;
+    bool resume = false;
+    bool follow = false;
+
+    bool sampling() const {
+        return sample < 1.0 || label_rates != nullptr || reservoir != 0u;
+    }
+};
+
+inline void print_usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [--input FILE] [--csv] [--threads N] [--unordered]"
+              << " [--chunk-size BYTES] [--vocab FILE] [--vocab-out FILE]"
+              << " [--vocab-unseen oov|sign|grow]"
+              << " [--format text|binary|libsvm|libffm] [--hash-space N] [--catnum-weights]"
+              << " [--instances FILE] [--labels FILE] [--diagnostics FILE] [--label-first]"
+              << " [--max-diagnostics N] [--compress none|gzip|zstd] [--compress-level N]"
+              << " [--batch @LIST|GLOB --output-dir DIR [--manifest FILE]]"
+              << " [--stats FILE [--stats-interval SECONDS]] [--buckets FILE | --fit-buckets FILE]"
+              << " [--profile FILE]"
+              << " [--dedup row|COLUMNS [--dedup-capacity N] [--dedup-fp-rate F]]"
+              << " [--sample RATE] [--label-rates LABEL:RATE,...] [--sample-key COLUMN]"
+              << " [--sample-seed N] [--reservoir N] [--sample-weight]"
+              << " [--checkpoint FILE [--checkpoint-interval SECONDS] [--resume]] [--follow]"
+              << " <Feature Flags>" << std::endl;
+}
+
+inline bool parse_size_arg(const char* arg, size_t& value) {
+    char* end = nullptr;
+    unsigned long long v = strtoull(arg, &end, 10);
+    if (end == arg || *end != '\0') {
+        return false;
+    }
+    value = v;
+    return true;
+}
+
+inline int parse_cli_options(int argc, char* argv[], CliOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        if (strcmp(arg, "--threads") == 0 && i + 1 < argc) {
+            if (!parse_size_arg(argv[++i], options.threads)) {
+                std::cerr << "invalid --threads [" << argv[i] << "]" << std::endl;
+                return -1;
+            }
+        } else if (strcmp(arg, "--input") == 0 && i + 1 < argc) {
+            options.input = argv[++i];
+        } else if (strcmp(arg, "--vocab") == 0 && i + 1 < argc) {
+            options.vocab = argv[++i];
+        } else if (strcmp(arg, "--vocab-out") == 0 && i + 1 < argc) {
+            options.vocab_out = argv[++i];
+        } else if (strcmp(arg, "--vocab-unseen") == 0 && i + 1 < argc) {
+            options.vocab_unseen = argv[++i];
+        } else if (strcmp(arg, "--format") == 0 && i + 1 < argc) {
+            options.format = argv[++i];
+        } else if (strcmp(arg, "--hash-space") == 0 && i + 1 < argc) {
+            if (!parse_size_arg(argv[++i], options.hash_space) || options.hash_space == 0u) {
+                std::cerr << "invalid --hash-space [" << argv[i] << "]" << std::endl;
+                return -1;
+            }
+        } else if (strcmp(arg, "--instances") == 0 && i + 1 < argc) {
+            options.instances = argv[++i];
+        } else if (strcmp(arg, "--labels") == 0 && i + 1 < argc) {
+            options.labels = argv[++i];
+        } else if (strcmp(arg, "--diagnostics") == 0 && i + 1 < argc) {
+            options.diagnostics = argv[++i];
+        } else if (strcmp(arg, "--compress") == 0 && i + 1 < argc) {
+            options.compress = argv[++i];
+        } else if (strcmp(arg, "--compress-level") == 0 && i + 1 < argc) {
+            char* end = nullptr;
+            options.compress_level = strtol(argv[++i], &end, 10);
+            if (end == argv[i] || *end != '\0') {
+                std::cerr << "invalid --compress-level [" << argv[i] << "]" << std::endl;
+                return -1;
+            }
+        } else if (strcmp(arg, "--batch") == 0 && i + 1 < argc) {
+            options.batch = argv[++i];
+        } else if (strcmp(arg, "--output-dir") == 0 && i + 1 < argc) {
+            options.output_dir = argv[++i];
+        } else if (strcmp(arg, "--manifest") == 0 && i + 1 < argc) {
+            options.manifest = argv[++i];
+        } else if (strcmp(arg, "--buckets") == 0 && i + 1 < argc) {
+            options.buckets = argv[++i];
+        } else if (strcmp(arg, "--fit-buckets") == 0 && i + 1 < argc) {
+            options.fit_buckets = argv[++i];
+        } else if (strcmp(arg, "--profile") == 0 && i + 1 < argc) {
+            options.profile = argv[++i];
+        } else if (strcmp(arg, "--stats") == 0 && i + 1 < argc) {
+            options.stats = argv[++i];
+        } else if (strcmp(arg, "--stats-interval") == 0 && i + 1 < argc) {
+            char* end = nullptr;
+            options.stats_interval = strtod(argv[++i], &end);
+            if (end == argv[i] || *end != '\0' || !(options.stats_interval >= 0.0)) {
+                std::cerr << "invalid --stats-interval [" << argv[i] << "]" << std::endl;
+                return -1;
+            }
+        } else if (strcmp(arg, "--dedup") == 0 && i + 1 < argc) {
+            options.dedup = argv[++i];
+        } else if (strcmp(arg, "--dedup-capacity") == 0 && i + 1 < argc) {
+            size_t capacity = 0u;
+            if (!parse_size_arg(argv[++i], capacity) || capacity == 0u) {
+                std::cerr << "invalid --dedup-capacity [" << argv[i] << "]" << std::endl;
+                return -1;
+            }
+            options.dedup_capacity = capacity;
+        } else if (strcmp(arg, "--dedup-fp-rate") == 0 && i + 1 < argc) {
+            char* end = nullptr;
+            options.dedup_fp_rate = strtod(argv[++i], &end);
+            if (end == argv[i] || *end != '\0' ||
+                    !(options.dedup_fp_rate > 0.0 && options.dedup_fp_rate < 1.0)) {
+                std::cerr << "invalid --dedup-fp-rate [" << argv[i] << "]" << std::endl;
+                return -1;
+            }
+        } else if (strcmp(arg, "--sample") == 0 && i + 1 < argc) {
+            char* end = nullptr;
+            options.sample = strtod(argv[++i], &end);
+            if (end == argv[i] || *end != '\0' || !(options.sample > 0.0 && options.sample <= 1.0)) {
+                std::cerr << "invalid --sample [" << argv[i] << "]" << std::endl;
+                return -1;
+            }
+        } else if (strcmp(arg, "--label-rates") == 0 && i + 1 < argc) {
+            options.label_rates = argv[++i];
+        } else if (strcmp(arg, "--sample-key") == 0 && i + 1 < argc) {
+            options.sample_key = argv[++i];
+        } else if (strcmp(arg, "--sample-seed") == 0 && i + 1 < argc) {
+            size_t seed = 0u;
+            if (!parse_size_arg(argv[++i], seed)) {
+                std::cerr << "invalid --sample-seed [" << argv[i] << "]" << std::endl;
+                return -1;
+            }
+            options.sample_seed = seed;
+        } else if (strcmp(arg, "--reservoir") == 0 && i + 1 < argc) {
+            if (!parse_size_arg(argv[++i], options.reservoir) || options.reservoir == 0u) {
+                std::cerr << "invalid --reservoir [" << argv[i] << "]" << std::endl;
+                return -1;
+            }
+        } else if (strcmp(arg, "--sample-weight") == 0) {
+            options.sample_weight = true;
+        } else if (strcmp(arg, "--checkpoint") == 0 && i + 1 < argc) {
+            options.checkpoint = argv[++i];
+        } else if (strcmp(arg, "--checkpoint-interval") == 0 && i + 1 < argc) {
+            char* end = nullptr;
+            options.checkpoint_interval = strtod(argv[++i], &end);
+            if (end == argv[i] || *end != '\0' || !(options.checkpoint_interval >= 0.0)) {
+                std::cerr << "invalid --checkpoint-interval [" << argv[i] << "]" << std::endl;
+                return -1;
+            }
+        } else if (strcmp(arg, "--resume") == 0) {
+            options.resume = true;
+        } else if (strcmp(arg, "--follow") == 0) {
+            options.follow = true;
+        } else if (strcmp(arg, "--label-first") == 0) {
+            options.label_first = true;
+        } else if (strcmp(arg, "--max-diagnostics") == 0 && i + 1 < argc) {
+            size_t limit = 0u;
+            if (!parse_size_arg(argv[++i], limit)) {
+                std::cerr << "invalid --max-diagnostics [" << argv[i] << "]" << std::endl;
+                return -1;
+            }
+            options.max_diagnostics = limit;
+        } else if (strcmp(arg, "--csv") == 0) {
+            options.csv = true;
+        } else if (strcmp(arg, "--catnum-weights") == 0) {
+            options.catnum_weights = true;
+        } else if (strcmp(arg, "--unordered") == 0) {
+            options.ordered = false;
+        } else if (strcmp(arg, "--chunk-size") == 0 && i + 1 < argc) {
+            if (!parse_size_arg(argv[++i], options.chunk_size) || options.chunk_size == 0u) {
+                std::cerr << "invalid --chunk-size [" << argv[i] << "]" << std::endl;
+                return -1;
+            }
+        } else if (strncmp(arg, "--", 2) != 0 && options.feature_flags == nullptr) {
+            options.feature_flags = arg;
+        } else {
+            std::cerr << "unknown argument: " << arg << std::endl;
+            return -1;
+        }
+    }
+    if (options.feature_flags == nullptr) {
+        return -1;
+    }
+    if (options.batch != nullptr && (options.output_dir == nullptr || options.input != nullptr ||
+            options.instances != nullptr || options.labels != nullptr)) {
+        std::cerr << "--batch needs --output-dir and writes its own shards,"
+                  << " it cannot be combined with --input, --instances or --labels." << std::endl;
+        return -1;
+    }
+    const CliOptions defaults;
+    if ((options.dedup_capacity != defaults.dedup_capacity ||
+            options.dedup_fp_rate != defaults.dedup_fp_rate) && options.dedup == nullptr) {
+        std::cerr << "--dedup-capacity and --dedup-fp-rate need --dedup." << std::endl;
+        return -1;
+    }
+    if ((options.sample_key != nullptr || options.sample_weight) && !options.sampling()) {
+        std::cerr << "--sample-key and --sample-weight need --sample, --label-rates"
+                  << " or --reservoir." << std::endl;
+        return -1;
+    }
+    // binary rows have no place for the label, libsvm/libffm lines always
+    // start with it.
+    if (options.label_first && strcmp(options.format, "text") != 0) {
+        std::cerr << "--label-first needs --format text." << std::endl;
+        return -1;
+    }
+    if (options.reservoir != 0u && options.batch != nullptr) {
+        std::cerr << "--reservoir cannot be combined with --batch." << std::endl;
+        return -1;
+    }
+    if ((options.resume || options.checkpoint_interval != defaults.checkpoint_interval) &&
+            options.checkpoint == nullptr) {
+        std::cerr << "--resume and --checkpoint-interval need --checkpoint." << std::endl;
+        return -1;
+    }
+    if (options.checkpoint != nullptr || options.follow) {
+        // offsets are taken from the input and the output files as they are
+        // written, in input order; state kept in memory would not survive.
+        if (options.input == nullptr ||
+                (options.checkpoint != nullptr && options.instances == nullptr) ||
+                strcmp(options.compress, "none") != 0 || !options.ordered) {
+            std::cerr << "--checkpoint and --follow need --input, --checkpoint needs --instances;"
+                      << " output has to be uncompressed and ordered." << std::endl;
+            return -1;
+        }
+        if (options.batch != nullptr || options.profile != nullptr ||
+                options.fit_buckets != nullptr || options.vocab_out != nullptr ||
+                options.dedup != nullptr || options.reservoir != 0u) {
+            std::cerr << "--checkpoint and --follow cannot be combined with --batch, --profile,"
+                      << " --fit-buckets, --vocab-out, --dedup or --reservoir." << std::endl;
+            return -1;
+        }
+    }
+    if (options.stats_interval > 0.0 && options.stats == nullptr) {
+        std::cerr << "--stats-interval needs --stats." << std::endl;
+        return -1;
+    }
+    if (options.threads == 0u) {
+        options.threads = std::thread::hardware_concurrency();
+        if (options.threads == 0u) {
+            options.threads = 1u;
+        }
+    }
+    return 0;
+}
+
+#endif // DATA_CLEANER_CLI_OPTIONS_H
@@ -0,0 +1,1178 @@
+#ifndef DATA_CLEANER_COLUMN_PLAN_H
+#define DATA_CLEANER_COLUMN_PLAN_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "MurmurHash3.h"
+#include "diagnostics.h"
+#include "file_line_reader.h"
+#include "output_buffer.h"
+#include "output_sinks.h"
+#include "quantile_sketch.h"
+#include "row_dedup.h"
+#include "row_format.h"
+#include "row_sampler.h"
+#include "run_stats.h"
+#include "str_view.h"
+#include "time_parser.h"
+#include "tokenizer.h"
+#include "vocabulary.h"
+
+enum Oflag : int {
+    NUM = 0,
+    CAT = 1,
+    MULTI_CAT = 2,
+    TIME = 3,
+    MULTI_CAT_NUM = 4,
+    LABEL = 5,
+    NUM_BUCKET = 6,
+    IGNORE = 99
+};
+
+// What Multi-Valued CatNumerical writes besides its keys: the key with the
+// largest and/or smallest value, the k keys with the largest (TopK) or
+// smallest (BottomK) values, or the values of all keys (Weighted).
+enum CatnumFlag : int {
+    MAX = 0,
+    MIN = 1,
+    MAXMIN = 2,
+    TOPK = 3,
+    BOTTOMK = 4,
+    WEIGHTED = 5
+};
+
+// What the data_clean front ends differ in. The defaults are data_format's.
+struct CleanerDialect {
+    // Multi-Valued columns name their delimiters in the schema, e.g.
+    // "Multi-Valued Categorical#|" and "Multi-Valued CatNumerical#Max#;#:".
+    // Otherwise they are ',' and ';' ':'.
+    bool schema_delims = true;
+    // Numerical values are parsed and shifted by num_offset instead of being
+    // copied through as text.
+    bool parse_numerical = false;
+    double num_offset = 0.0;
+    time_t time_offset = 0;
+    // an empty token is NaN for every column, not only for Multi-Valued
+    // CatNumerical and Time.
+    bool empty_is_null = true;
+    // a null Multi-Valued CatNumerical also writes NaN for its Max/Min slots.
+    bool pad_catnum_nulls = true;
+    // the diagnostic of a CatNumerical item without CAT:VALUE ends in the
+    // column number.
+    bool catnum_diag_column = false;
+};
+
+// How instances are written: space separated text, binary rows (see
+// row_format.h) or sparse "label index:value" / "label field:index:value"
+// lines for libsvm and libffm.
+enum OutputFormat : int {
+    OUTPUT_TEXT = 0,
+    OUTPUT_BINARY = 1,
+    OUTPUT_LIBSVM = 2,
+    OUTPUT_LIBFFM = 3
+};
+
+inline int parse_output_format(const char* name, OutputFormat& format) {
+    if (strcmp(name, "text") == 0) {
+        format = OUTPUT_TEXT;
+    } else if (strcmp(name, "binary") == 0) {
+        format = OUTPUT_BINARY;
+    } else if (strcmp(name, "libsvm") == 0) {
+        format = OUTPUT_LIBSVM;
+    } else if (strcmp(name, "libffm") == 0) {
+        format = OUTPUT_LIBFFM;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+const unsigned int SIGN_SEED = 32u;
+const char ODELIM = ' ';
+
+struct Column;
+
+// One CAT:VALUE pair, kept for the TopK, BottomK and Weighted modes.
+struct CatnumPair {
+    double value;
+    size_t position;
+    uint64_t sign;
+};
+
+// One libsvm/libffm feature of the current row, see write_features.
+struct SparseFeature {
+    size_t field;
+    uint64_t index;
+    double weight;
+};
+
+struct LineContext {
+    Tokenizer& tokenizer;
+    LocalTimeCache& time_cache;
+    RowEncoder& rows;
+    OutputBuffer& out;
+    OutputBuffer& labels;
+    OutputBuffer& diag;
+    OutputBuffer& discard;
+    DiagnosticCounters& counters;
+    // diagnostics of this worker so far, and its --stats counters if enabled.
+    uint64_t& diagnosed;
+    ThreadStats* stats;
+    std::vector<CatnumPair>& catnum_pairs;
+    std::vector<uint64_t>& item_signs;
+    std::vector<SparseFeature>& features;
+
+    // counts a diagnostic and returns the buffer to write it to, a scratch
+    // buffer once `kind` is over its limit.
+    OutputBuffer& diagnose(DiagKind kind) {
+        ++diagnosed;
+        if (counters.report(kind)) {
+            return diag;
+        }
+        discard.clear();
+        return discard;
+    }
+};
+
+// Writes the output of one token; `last` is true for the last token of the
+// line, which is not followed by the output delimiter.
+typedef void (*ColumnHandler)(const Column& column, StrView token, bool last, LineContext& ctx);
+
+// One compiled schema line. Everything the handler needs is stored inline so
+// the row loop does no lookups and no branching on the column type.
+struct Column {
+    Oflag oflag = Oflag::IGNORE;
+    size_t index = 0u;
+    ColumnHandler handler = nullptr;
+    // with --stats, `handler` counts the cell and calls this one.
+    ColumnHandler counted_handler = nullptr;
+    bool empty_is_null = true;
+    bool catnum_diag_column = false;
+    std::string null_text;
+    char delims[2] = {',', ';'};
+    CatnumFlag catnum_flag = CatnumFlag::MAX;
+    // k of TopK#k and BottomK#k.
+    size_t catnum_k = 1u;
+    std::string time_format;
+    TimeLayout time_layout = TIME_GENERIC;
+    time_t time_offset = 0;
+    double num_offset = 0.0;
+    // Numerical#Bucket#N: the boundaries fitted for the column, see
+    // set_bucket_bounds, and the sign of every bucket.
+    size_t buckets = 0u;
+    std::vector<double> bucket_bounds;
+    std::vector<uint64_t> bucket_signs;
+    // dense ids instead of signs for categorical columns, see --vocab.
+    VocabColumn* vocab = nullptr;
+    // first slot of the column in binary rows.
+    size_t slot = 0u;
+    // libsvm/libffm: the field of the features (the column on libffm lines),
+    // the feature indices are signs modulo hash_space. Numerical and Time
+    // columns are one feature, feature_sign, weighted by the value.
+    size_t feature_field = 0u;
+    uint64_t hash_space = 1u;
+    uint64_t feature_sign = 0u;
+    bool catnum_weights = false;
+};
+
+struct ColumnPlan {
+    OutputFormat format = OUTPUT_TEXT;
+    // libsvm/libffm feature index range and whether Multi-Valued CatNumerical
+    // writes its CAT:VALUE pairs as weighted features instead of max/min.
+    uint64_t hash_space = 1u << 24;
+    bool catnum_weights = false;
+    // text lines start with the label instead of writing it to the labels sink.
+    bool label_first = false;
+    // the field delimiter, and whether fields may be double quoted (--csv).
+    char field_delim = '\t';
+    bool quoted = false;
+    std::vector<Column> columns;
+    // the Label column, written first on libsvm/libffm and --label-first lines.
+    size_t label_column = std::numeric_limits<size_t>::max();
+    // binary row layout, one entry per written value.
+    std::vector<RowSlot> slots;
+    // --stats counters, see enable_column_stats.
+    RunStats* stats = nullptr;
+    // --dedup filter, shared by every worker.
+    RowDeduplicator* dedup = nullptr;
+    // --sample, --label-rates, --sample-key and --reservoir, and with
+    // --sample-weight the binary slot of the weight (one past the columns on
+    // text lines, label:weight on libsvm/libffm lines).
+    RowSampler* sampler = nullptr;
+    bool sample_weight = false;
+    size_t weight_slot = 0u;
+
+    // dense ids are small, so they are stored as varint deltas.
+    uint32_t row_flags() const {
+        for (const auto& column : columns) {
+            if (column.vocab != nullptr) {
+                return ROW_SIGNS_VARINT_DELTA;
+            }
+        }
+        return 0u;
+    }
+
+    bool has_buckets() const {
+        for (const auto& column : columns) {
+            if (column.oflag == Oflag::NUM_BUCKET) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // every sub delimiter the Tokenizer has to index.
+    std::vector<char> sub_delims() const {
+        std::vector<char> delims;
+        for (const auto& column : columns) {
+            if (column.oflag == Oflag::MULTI_CAT) {
+                delims.push_back(column.delims[0]);
+            } else if (column.oflag == Oflag::MULTI_CAT_NUM) {
+                delims.push_back(column.delims[0]);
+                delims.push_back(column.delims[1]);
+            }
+        }
+        return delims;
+    }
+
+    // the columns the row loop reads, for Tokenizer::project: all but the
+    // Ignore ones that are no --dedup or --sample-key key. Empty if that is
+    // every column, or with --stats, which counts the cells of Ignore columns
+    // too.
+    std::vector<bool> projection() const {
+        std::vector<bool> needed;
+        if (stats != nullptr) {
+            return needed;
+        }
+        for (const auto& column : columns) {
+            needed.push_back(column.oflag != Oflag::IGNORE);
+        }
+        if (dedup != nullptr) {
+            for (size_t column : dedup->columns()) {
+                needed[column] = true;
+            }
+        }
+        if (sampler != nullptr && sampler->key_column() < needed.size()) {
+            needed[sampler->key_column()] = true;
+        }
+        bool ignored = false;
+        for (bool need : needed) {
+            ignored = ignored || !need;
+        }
+        if (!ignored) {
+            needed.clear();
+        }
+        return needed;
+    }
+};
+
+// State the row loop reuses from line to line; every pipeline worker owns
+// one. Only the diagnostic counters are shared; every copy gets counters of
+// its own in the run's stats and a sampling stream of its own.
+struct ThreadContext {
+    ThreadContext(const ColumnPlan& plan, DiagnosticCounters& counters)
+        : tokenizer(plan.field_delim, plan.sub_delims(), plan.quoted), rows(plan.slots, plan.row_flags()),
+          counters(counters), run_stats(plan.stats),
+          stats(run_stats != nullptr ? run_stats->add_thread() : nullptr),
+          sampler(plan.sampler),
+          sample_state(sampler != nullptr ? sampler->thread_state() : 0u) {
+        tokenizer.project(plan.projection());
+    }
+
+    ThreadContext(const ThreadContext& other)
+        : tokenizer(other.tokenizer), time_cache(other.time_cache), rows(other.rows),
+          counters(other.counters), run_stats(other.run_stats),
+          stats(run_stats != nullptr ? run_stats->add_thread() : nullptr),
+          sampler(other.sampler),
+          sample_state(sampler != nullptr ? sampler->thread_state() : 0u) {}
+
+    Tokenizer tokenizer;
+    LocalTimeCache time_cache;
+    RowEncoder rows;
+    DiagnosticCounters& counters;
+    OutputBuffer discard{0u};
+    // the pairs of the current Multi-Valued CatNumerical cell.
+    std::vector<CatnumPair> catnum_pairs;
+    // the signs of the items of the current Multi-Valued Categorical cell.
+    std::vector<uint64_t> item_signs;
+    // the libsvm/libffm features of the current row.
+    std::vector<SparseFeature> features;
+    uint64_t diagnosed = 0u;
+    RunStats* run_stats;
+    ThreadStats* stats;
+    // the random stream of --sample, and a row bound for the --reservoir.
+    RowSampler* sampler;
+    uint64_t sample_state;
+    OutputBuffer held_instance{0u};
+    OutputBuffer held_label{0u};
+    // where write_row put the --sample-weight into the instance buffer.
+    size_t weight_begin = 0u;
+    size_t weight_end = 0u;
+};
+
+inline time_t calc_time(StrView str, const char* format, LineContext& ctx) {
+    std::tm tmp_time = {};
+    std::istringstream ss(to_string(str));
+    ss >> std::get_time(&tmp_time, format);
+    if (ss.fail()) {
+        ctx.diagnose(DIAG_TIME) << "fail to covert time[" << str << "]\n";
+        return (time_t)-1;
+    }
+    return std::mktime(&tmp_time);
+}
+
+// A Time token as written, offset included.
+inline time_t parse_time(const Column& column, StrView token, LineContext& ctx) {
+    time_t t = 0;
+    if (!parse_time_fast(token, column.time_layout, ctx.time_cache, t)) {
+        t = calc_time(token, column.time_format.c_str(), ctx);
+    }
+    return t + column.time_offset;
+}
+
+// The sign of a categorical value, or its dense id with a vocabulary.
+inline uint64_t column_id(const Column& column, uint64_t sign) {
+    return column.vocab == nullptr ? sign : column.vocab->map(sign);
+}
+
+// Installs fitted boundaries; bucket b of column c gets the sign of (c, b).
+inline void set_bucket_bounds(Column& column, std::vector<double> bounds) {
+    column.bucket_bounds = std::move(bounds);
+    column.bucket_signs.clear();
+    for (uint64_t b = 0u; b <= column.bucket_bounds.size(); ++b) {
+        uint64_t key[2] = {column.index, b};
+        column.bucket_signs.push_back(MurmurHash64A(key, sizeof(key), SIGN_SEED));
+    }
+}
+
+inline uint64_t bucket_sign(const Column& column, StrView token) {
+    return column.bucket_signs[bucket_index(column.bucket_bounds, view_strtod(token))];
+}
+
+inline void transform_num_text(const Column&, StrView token, LineContext& ctx) {
+    ctx.out << token;
+}
+
+inline void transform_num_parsed(const Column& column, StrView token, LineContext& ctx) {
+    ctx.out << view_strtod(token) + column.num_offset;
+}
+
+inline void transform_num_bucket(const Column& column, StrView token, LineContext& ctx) {
+    ctx.out << bucket_sign(column, token);
+}
+
+inline void transform_cat(const Column& column, StrView token, LineContext& ctx) {
+    ctx.out << column_id(column, MurmurHash64A(token.data, token.size, SIGN_SEED));
+}
+
+// The signs of the items of a Multi-Valued Categorical cell, hashed in one
+// batch.
+inline const std::vector<uint64_t>& item_signs(const Column& column, StrView token,
+        LineContext& ctx) {
+    const auto& subtokens = ctx.tokenizer.split_field(token, column.delims[0]);
+    ctx.item_signs.resize(subtokens.size());
+    MurmurHash64A_batch(subtokens.data(), subtokens.size(), SIGN_SEED, ctx.item_signs.data());
+    return ctx.item_signs;
+}
+
+inline void transform_multi_cat(const Column& column, StrView token, LineContext& ctx) {
+    const auto& signs = item_signs(column, token, ctx);
+    for (size_t j = 0u; j < signs.size(); ++j) {
+        ctx.out << column_id(column, signs[j]);
+        if (j + 1 != signs.size()) {
+            ctx.out << ',';
+        }
+    }
+}
+
+// Calls `on_sign(j, sign, value)` for every CAT:VALUE pair and returns the
+// signs of the keys with the largest and the smallest value. The TopK,
+// BottomK and Weighted modes get every pair in ctx.catnum_pairs as well.
+template <typename SignFn>
+void scan_multi_cat_num(const Column& column, StrView token, LineContext& ctx, SignFn on_sign,
+        uint64_t& max_sign, uint64_t& min_sign) {
+    const auto& subtokens = ctx.tokenizer.split_field(token, column.delims[0]);
+    double max = std::numeric_limits<double>::lowest();
+    double min = std::numeric_limits<double>::max();
+    bool keep_pairs = column.catnum_flag >= CatnumFlag::TOPK;
+    max_sign = 0u;
+    min_sign = 0u;
+    ctx.catnum_pairs.clear();
+    for (size_t j = 0u; j < subtokens.size(); ++j) {
+        StrView key, value;
+        size_t parts = split_pair(subtokens[j], column.delims[1], key, value);
+        if (parts != 2u) {
+            OutputBuffer& diag = ctx.diagnose(DIAG_CATNUM_PAIR);
+            diag << "There should be CAT:VALUE for CatNumerical";
+            if (column.catnum_diag_column) {
+                diag << column.index;
+            }
+            diag << '\n';
+        }
+        uint64_t sign = column_id(column, MurmurHash64A(key.data, key.size, SIGN_SEED));
+        double num = 0.0;
+        if (!parse_number(value, num) && parts != 1u) {
+            ctx.diagnose(DIAG_NUMBER) << "error value format, transform to double failed, [" << value << "]\n";
+        }
+        on_sign(j, sign, num);
+        if (keep_pairs) {
+            ctx.catnum_pairs.push_back(CatnumPair{num, j, sign});
+        }
+        if (num >= max) {
+            max = num;
+            max_sign = sign;
+        }
+        if (num <= min) {
+            min = num;
+            min_sign = sign;
+        }
+    }
+}
+
+// Moves the `k` pairs that come first by `before` to the front, in that
+// order: nth_element finds them in linear time and only they are sorted.
+template <typename Before>
+void select_pairs(std::vector<CatnumPair>& pairs, size_t k, Before before) {
+    if (k < pairs.size()) {
+        std::nth_element(pairs.begin(), pairs.begin() + k, pairs.end(), before);
+    }
+    std::sort(pairs.begin(), pairs.begin() + k, before);
+}
+
+// The number of pairs at the front of ctx.catnum_pairs that the TopK,
+// BottomK or Weighted column writes besides its keys. Pairs without a value
+// (NaN) are never selected; of equal values the later pair comes first, as
+// with Max and Min.
+inline size_t select_catnum_pairs(const Column& column, LineContext& ctx) {
+    std::vector<CatnumPair>& pairs = ctx.catnum_pairs;
+    if (column.catnum_flag == CatnumFlag::WEIGHTED) {
+        return pairs.size();
+    }
+    pairs.erase(std::remove_if(pairs.begin(), pairs.end(), [](const CatnumPair& pair) {
+        return std::isnan(pair.value);
+    }), pairs.end());
+    size_t k = std::min(column.catnum_k, pairs.size());
+    if (column.catnum_flag == CatnumFlag::TOPK) {
+        select_pairs(pairs, k, [](const CatnumPair& a, const CatnumPair& b) {
+            return a.value > b.value || (a.value == b.value && a.position > b.position);
+        });
+    } else {
+        select_pairs(pairs, k, [](const CatnumPair& a, const CatnumPair& b) {
+            return a.value < b.value || (a.value == b.value && a.position > b.position);
+        });
+    }
+    return k;
+}
+
+inline void transform_multi_cat_num(const Column& column, StrView token, LineContext& ctx) {
+    uint64_t max_sign = 0u, min_sign = 0u;
+    scan_multi_cat_num(column, token, ctx, [&ctx](size_t j, uint64_t sign, double) {
+        if (j != 0u) {
+            ctx.out << ',';
+        }
+        ctx.out << sign;
+    }, max_sign, min_sign);
+    if (column.catnum_flag >= CatnumFlag::TOPK) {
+        size_t n = select_catnum_pairs(column, ctx);
+        ctx.out << ODELIM;
+        // like the Max key of a cell without values; Weighted writes as many
+        // values as keys.
+        if (n == 0u && column.catnum_flag != CatnumFlag::WEIGHTED) {
+            ctx.out << '0';
+        }
+        for (size_t j = 0u; j < n; ++j) {
+            if (j != 0u) {
+                ctx.out << ',';
+            }
+            if (column.catnum_flag == CatnumFlag::WEIGHTED) {
+                ctx.out << ctx.catnum_pairs[j].value;
+            } else {
+                ctx.out << ctx.catnum_pairs[j].sign;
+            }
+        }
+    } else if (column.catnum_flag == CatnumFlag::MAX) {
+        ctx.out << ODELIM << max_sign;
+    } else if (column.catnum_flag == CatnumFlag::MIN) {
+        ctx.out << ODELIM << min_sign;
+    } else {
+        ctx.out << ODELIM << max_sign << ODELIM << min_sign;
+    }
+}
+
+inline void transform_time(const Column& column, StrView token, LineContext& ctx) {
+    ctx.out << parse_time(column, token, ctx);
+}
+
+// The binary counterparts of the transforms, writing into ctx.rows.
+inline void encode_num(const Column& column, StrView token, LineContext& ctx) {
+    ctx.rows.put_double(column.slot, view_strtod(token) + column.num_offset);
+}
+
+inline void encode_num_bucket(const Column& column, StrView token, LineContext& ctx) {
+    ctx.rows.put_sign(column.slot, bucket_sign(column, token));
+}
+
+inline void encode_cat(const Column& column, StrView token, LineContext& ctx) {
+    ctx.rows.put_sign(column.slot, column_id(column,
+            MurmurHash64A(token.data, token.size, SIGN_SEED)));
+}
+
+inline void encode_multi_cat(const Column& column, StrView token, LineContext& ctx) {
+    for (uint64_t sign : item_signs(column, token, ctx)) {
+        ctx.rows.put_sign(column.slot, column_id(column, sign));
+    }
+}
+
+inline void encode_multi_cat_num(const Column& column, StrView token, LineContext& ctx) {
+    uint64_t max_sign = 0u, min_sign = 0u;
+    scan_multi_cat_num(column, token, ctx, [&column, &ctx](size_t, uint64_t sign, double) {
+        ctx.rows.put_sign(column.slot, sign);
+    }, max_sign, min_sign);
+    if (column.catnum_flag >= CatnumFlag::TOPK) {
+        size_t n = select_catnum_pairs(column, ctx);
+        if (n == 0u && column.catnum_flag != CatnumFlag::WEIGHTED) {
+            ctx.rows.put_sign(column.slot + 1u, 0u);
+        }
+        for (size_t j = 0u; j < n; ++j) {
+            if (column.catnum_flag == CatnumFlag::WEIGHTED) {
+                ctx.rows.put_double(column.slot + 1u, ctx.catnum_pairs[j].value);
+            } else {
+                ctx.rows.put_sign(column.slot + 1u, ctx.catnum_pairs[j].sign);
+            }
+        }
+    } else if (column.catnum_flag == CatnumFlag::MAX) {
+        ctx.rows.put_sign(column.slot + 1u, max_sign);
+    } else if (column.catnum_flag == CatnumFlag::MIN) {
+        ctx.rows.put_sign(column.slot + 1u, min_sign);
+    } else {
+        ctx.rows.put_sign(column.slot + 1u, max_sign);
+        ctx.rows.put_sign(column.slot + 2u, min_sign);
+    }
+}
+
+inline void encode_time(const Column& column, StrView token, LineContext& ctx) {
+    ctx.rows.put_int(column.slot, parse_time(column, token, ctx));
+}
+
+inline void handle_ignore(const Column&, StrView, bool, LineContext&) {
+}
+
+inline void handle_label(const Column&, StrView token, bool, LineContext& ctx) {
+    ctx.labels << token << '\n';
+}
+
+inline bool is_null(const Column& column, StrView token) {
+    return (token.size == 0u && column.empty_is_null) || equals(token, "null");
+}
+
+template <void (*Transform)(const Column&, StrView, LineContext&)>
+void handle_value(const Column& column, StrView token, bool last, LineContext& ctx) {
+    if (is_null(column, token)) {
+        ctx.out << column.null_text;
+    } else {
+        Transform(column, token, ctx);
+    }
+    if (!last) {
+        ctx.out << ODELIM;
+    }
+}
+
+// The libsvm/libffm counterparts; the features are collected and written
+// by write_features once the row is complete.
+inline void write_feature(const Column& column, uint64_t sign, double weight,
+        LineContext& ctx) {
+    ctx.features.push_back({column.feature_field, sign % column.hash_space, weight});
+}
+
+inline void write_feature(const Column& column, uint64_t sign, LineContext& ctx) {
+    write_feature(column, sign, 1.0, ctx);
+}
+
+// Writes the features of the row as " [field:]index:weight", sorted by field
+// and index as libsvm and liblinear require. Features that hash to the same
+// index of a field are one feature whose weight is the sum of theirs.
+inline void write_features(bool fields, LineContext& ctx) {
+    auto& features = ctx.features;
+    std::sort(features.begin(), features.end(),
+            [](const SparseFeature& a, const SparseFeature& b) {
+        return a.field != b.field ? a.field < b.field : a.index < b.index;
+    });
+    for (size_t i = 0u; i < features.size();) {
+        const SparseFeature& feature = features[i];
+        double weight = 0.0;
+        for (; i < features.size() && features[i].field == feature.field &&
+                features[i].index == feature.index; ++i) {
+            weight += features[i].weight;
+        }
+        ctx.out << ' ';
+        if (fields) {
+            ctx.out << feature.field << ':';
+        }
+        ctx.out << feature.index << ':' << weight;
+    }
+    features.clear();
+}
+
+inline void sparse_num(const Column& column, StrView token, LineContext& ctx) {
+    write_feature(column, column.feature_sign, view_strtod(token) + column.num_offset, ctx);
+}
+
+inline void sparse_num_bucket(const Column& column, StrView token, LineContext& ctx) {
+    write_feature(column, bucket_sign(column, token), ctx);
+}
+
+inline void sparse_cat(const Column& column, StrView token, LineContext& ctx) {
+    write_feature(column, column_id(column, MurmurHash64A(token.data, token.size, SIGN_SEED)),
+            ctx);
+}
+
+inline void sparse_multi_cat(const Column& column, StrView token, LineContext& ctx) {
+    for (uint64_t sign : item_signs(column, token, ctx)) {
+        write_feature(column, column_id(column, sign), ctx);
+    }
+}
+
+// The max/min keys are features of their own, apart from the plain keys.
+inline uint64_t catnum_role_sign(uint64_t sign, RowSlotRole role) {
+    return MurmurHash64A(&sign, sizeof(sign), SIGN_SEED + role);
+}
+
+inline void sparse_multi_cat_num(const Column& column, StrView token, LineContext& ctx) {
+    uint64_t max_sign = 0u, min_sign = 0u;
+    scan_multi_cat_num(column, token, ctx, [&column, &ctx](size_t, uint64_t sign, double value) {
+        if (column.catnum_weights) {
+            write_feature(column, sign, value, ctx);
+        } else {
+            write_feature(column, sign, ctx);
+        }
+    }, max_sign, min_sign);
+    if (column.catnum_weights) {
+        return;
+    }
+    if (column.catnum_flag == CatnumFlag::TOPK || column.catnum_flag == CatnumFlag::BOTTOMK) {
+        RowSlotRole role = column.catnum_flag == CatnumFlag::TOPK ? ROW_ROLE_MAX : ROW_ROLE_MIN;
+        size_t n = select_catnum_pairs(column, ctx);
+        if (n == 0u) {
+            write_feature(column, catnum_role_sign(0u, role), ctx);
+        }
+        for (size_t j = 0u; j < n; ++j) {
+            write_feature(column, catnum_role_sign(ctx.catnum_pairs[j].sign, role), ctx);
+        }
+        return;
+    }
+    if (column.catnum_flag != CatnumFlag::MIN) {
+        write_feature(column, catnum_role_sign(max_sign, ROW_ROLE_MAX), ctx);
+    }
+    if (column.catnum_flag != CatnumFlag::MAX) {
+        write_feature(column, catnum_role_sign(min_sign, ROW_ROLE_MIN), ctx);
+    }
+}
+
+inline void sparse_time(const Column& column, StrView token, LineContext& ctx) {
+    write_feature(column, column.feature_sign, static_cast<double>(parse_time(column, token, ctx)),
+            ctx);
+}
+
+// Null values leave their binary slots empty, which marks them null in the
+// row, and are left out of libsvm/libffm lines.
+template <void (*Encode)(const Column&, StrView, LineContext&)>
+void handle_sparse_value(const Column& column, StrView token, bool, LineContext& ctx) {
+    if (!is_null(column, token)) {
+        Encode(column, token, ctx);
+    }
+}
+
+// Binary output handlers; Numerical values are always stored parsed.
+inline ColumnHandler binary_handler(Oflag oflag) {
+    switch (oflag) {
+    case Oflag::NUM:
+        return handle_sparse_value<encode_num>;
+    case Oflag::NUM_BUCKET:
+        return handle_sparse_value<encode_num_bucket>;
+    case Oflag::CAT:
+        return handle_sparse_value<encode_cat>;
+    case Oflag::MULTI_CAT:
+        return handle_sparse_value<encode_multi_cat>;
+    case Oflag::MULTI_CAT_NUM:
+        return handle_sparse_value<encode_multi_cat_num>;
+    case Oflag::TIME:
+        return handle_sparse_value<encode_time>;
+    case Oflag::LABEL:
+        return handle_label;
+    default:
+        return handle_ignore;
+    }
+}
+
+// libsvm/libffm handlers; the label is written by clean_line.
+inline ColumnHandler feature_handler(Oflag oflag) {
+    switch (oflag) {
+    case Oflag::NUM:
+        return handle_sparse_value<sparse_num>;
+    case Oflag::NUM_BUCKET:
+        return handle_sparse_value<sparse_num_bucket>;
+    case Oflag::CAT:
+        return handle_sparse_value<sparse_cat>;
+    case Oflag::MULTI_CAT:
+        return handle_sparse_value<sparse_multi_cat>;
+    case Oflag::MULTI_CAT_NUM:
+        return handle_sparse_value<sparse_multi_cat_num>;
+    case Oflag::TIME:
+        return handle_sparse_value<sparse_time>;
+    default:
+        return handle_ignore;
+    }
+}
+
+// Appends the binary row slots of `column` to the plan.
+inline void add_row_slots(ColumnPlan& plan, Column& column) {
+    column.slot = plan.slots.size();
+    RowSlot slot = {static_cast<uint32_t>(column.index), ROW_SLOT_SIGNS, ROW_ROLE_VALUE, 0u};
+    switch (column.oflag) {
+    case Oflag::NUM:
+        slot.type = ROW_SLOT_DOUBLE;
+        break;
+    case Oflag::TIME:
+        slot.type = ROW_SLOT_INT;
+        break;
+    case Oflag::CAT:
+    case Oflag::MULTI_CAT:
+    case Oflag::NUM_BUCKET:
+        break;
+    case Oflag::MULTI_CAT_NUM:
+        plan.slots.push_back(slot);
+        if (column.catnum_flag == CatnumFlag::WEIGHTED) {
+            slot.type = ROW_SLOT_DOUBLE;
+            slot.role = ROW_ROLE_WEIGHT;
+            plan.slots.push_back(slot);
+            return;
+        }
+        // TopK and BottomK keys are a list in the Max or Min slot.
+        if (column.catnum_flag != CatnumFlag::MIN && column.catnum_flag != CatnumFlag::BOTTOMK) {
+            slot.role = ROW_ROLE_MAX;
+            plan.slots.push_back(slot);
+        }
+        if (column.catnum_flag == CatnumFlag::MIN || column.catnum_flag == CatnumFlag::MAXMIN ||
+                column.catnum_flag == CatnumFlag::BOTTOMK) {
+            slot.role = ROW_ROLE_MIN;
+            plan.slots.push_back(slot);
+        }
+        return;
+    default:
+        return;
+    }
+    plan.slots.push_back(slot);
+}
+
+// Fills in the handler and the precomputed null output of a parsed column.
+inline void compile_column(const CleanerDialect& dialect, const ColumnPlan& plan,
+        Column& column) {
+    column.empty_is_null = dialect.empty_is_null ||
+        column.oflag == Oflag::MULTI_CAT_NUM || column.oflag == Oflag::TIME;
+    column.null_text = "NaN";
+    column.catnum_diag_column = dialect.catnum_diag_column;
+    column.time_offset = dialect.time_offset;
+    column.num_offset = dialect.num_offset;
+    switch (column.oflag) {
+    case Oflag::NUM:
+        column.handler = dialect.parse_numerical ?
+            handle_value<transform_num_parsed> : handle_value<transform_num_text>;
+        break;
+    case Oflag::NUM_BUCKET:
+        column.handler = handle_value<transform_num_bucket>;
+        break;
+    case Oflag::CAT:
+        column.handler = handle_value<transform_cat>;
+        break;
+    case Oflag::MULTI_CAT:
+        column.handler = handle_value<transform_multi_cat>;
+        break;
+    case Oflag::MULTI_CAT_NUM:
+        column.handler = handle_value<transform_multi_cat_num>;
+        if (dialect.pad_catnum_nulls) {
+            column.null_text += column.catnum_flag == CatnumFlag::MAXMIN ? " NaN NaN" : " NaN";
+        }
+        break;
+    case Oflag::TIME:
+        column.handler = handle_value<transform_time>;
+        break;
+    case Oflag::LABEL:
+        column.handler = plan.label_first ? handle_ignore : handle_label;
+        break;
+    default:
+        column.handler = handle_ignore;
+        break;
+    }
+    if (plan.format == OUTPUT_BINARY) {
+        column.handler = binary_handler(column.oflag);
+    } else if (plan.format == OUTPUT_LIBSVM || plan.format == OUTPUT_LIBFFM) {
+        column.handler = feature_handler(column.oflag);
+        column.feature_field = plan.format == OUTPUT_LIBFFM ? column.index : 0u;
+        column.hash_space = plan.hash_space;
+        uint64_t index = column.index;
+        column.feature_sign = MurmurHash64A(&index, sizeof(index), SIGN_SEED);
+        column.catnum_weights = plan.catnum_weights ||
+            column.catnum_flag == CatnumFlag::WEIGHTED;
+    }
+}
+
+// Counts the cell, whether it is null and whether it reported a diagnostic,
+// and times every TIME_SAMPLE-th one, around the real handler.
+inline void handle_counted(const Column& column, StrView token, bool last, LineContext& ctx) {
+    typedef std::chrono::steady_clock Clock;
+    ColumnStats& stats = ctx.stats->columns[column.index];
+    uint64_t cells = stats.cells.load(std::memory_order_relaxed);
+    bump(stats.cells);
+    if (is_null(column, token)) {
+        bump(stats.nulls);
+    }
+    uint64_t diagnosed = ctx.diagnosed;
+    if (cells % TIME_SAMPLE == 0u) {
+        Clock::time_point start = Clock::now();
+        column.counted_handler(column, token, last, ctx);
+        bump(stats.timed_cells);
+        bump(stats.timed_ns, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                Clock::now() - start).count());
+    } else {
+        column.counted_handler(column, token, last, ctx);
+    }
+    if (ctx.diagnosed != diagnosed) {
+        bump(stats.failures);
+    }
+}
+
+inline const char* oflag_name(Oflag oflag) {
+    switch (oflag) {
+    case Oflag::NUM:
+        return "Numerical";
+    case Oflag::NUM_BUCKET:
+        return "Numerical#Bucket";
+    case Oflag::CAT:
+        return "Categorical";
+    case Oflag::MULTI_CAT:
+        return "Multi-Valued Categorical";
+    case Oflag::MULTI_CAT_NUM:
+        return "Multi-Valued CatNumerical";
+    case Oflag::TIME:
+        return "Time";
+    case Oflag::LABEL:
+        return "Label";
+    default:
+        return "Ignore";
+    }
+}
+
+// The columns of the plan as named in the --stats summary.
+inline std::vector<StatsColumn> stats_columns(const ColumnPlan& plan) {
+    std::vector<StatsColumn> columns;
+    for (const auto& column : plan.columns) {
+        columns.push_back({column.index, oflag_name(column.oflag)});
+    }
+    return columns;
+}
+
+// Routes every column through handle_counted and every line through the
+// row counters of `stats`. Without it the row loop is left as it is.
+inline void enable_column_stats(ColumnPlan& plan, RunStats& stats) {
+    plan.stats = &stats;
+    for (auto& column : plan.columns) {
+        column.counted_handler = column.handler;
+        column.handler = handle_counted;
+    }
+}
+
+inline int parse_catnum_flag(StrView token, CatnumFlag& cnflag) {
+    if (equals(token, "Max")) {
+        cnflag = CatnumFlag::MAX;
+    } else if (equals(token, "Min")) {
+        cnflag = CatnumFlag::MIN;
+    } else if (equals(token, "MaxMin")) {
+        cnflag = CatnumFlag::MAXMIN;
+    } else if (equals(token, "TopK")) {
+        cnflag = CatnumFlag::TOPK;
+    } else if (equals(token, "BottomK")) {
+        cnflag = CatnumFlag::BOTTOMK;
+    } else if (equals(token, "Weighted")) {
+        cnflag = CatnumFlag::WEIGHTED;
+    } else {
+        std::cerr << "It can only be Max or Min or MaxMin or TopK#k or BottomK#k or Weighted, but ["
+                  << token << "]" << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+// Parses one schema line into `column`; returns -1 on a malformed line.
+inline int parse_feature_flag(StrView line, const CleanerDialect& dialect, Column& column) {
+    if (equals(line, "Numerical")) {
+        column.oflag = Oflag::NUM;
+    } else if (starts_with(line, "Numerical#")) {
+        auto tokens = split(line, '#');
+        size_t buckets = 0u;
+        if (tokens.size() != 3 || !equals(tokens[1], "Bucket") ||
+                !parse_count(tokens[2], buckets) || buckets < 2u) {
+            std::cerr << "For bucketized Numerical you should specify Numerical#Bucket#N, N >= 2." << std::endl;
+            return -1;
+        }
+        column.oflag = Oflag::NUM_BUCKET;
+        column.buckets = buckets;
+        set_bucket_bounds(column, std::vector<double>());
+    } else if (equals(line, "Categorical")) {
+        column.oflag = Oflag::CAT;
+    } else if (dialect.schema_delims ? starts_with(line, "Multi-Valued Categorical")
+                                     : equals(line, "Multi-Valued Categorical")) {
+        column.oflag = Oflag::MULTI_CAT;
+        if (dialect.schema_delims) {
+            auto tokens = split(line, '#');
+            if (tokens.size() != 2) {
+                std::cerr << "For Multi-Valued Categorical feature you should specify the delim" << std::endl;
+                return -1;
+            }
+            column.delims[0] = tokens[1].data[0];
+        } else {
+            column.delims[0] = ',';
+        }
+    } else if (starts_with(line, "Multi-Valued CatNumerical")) {
+        column.oflag = Oflag::MULTI_CAT_NUM;
+        auto tokens = split(line, '#');
+        // TopK#k and BottomK#k take two fields.
+        size_t flag_fields = tokens.size() > 1 &&
+            (equals(tokens[1], "TopK") || equals(tokens[1], "BottomK")) ? 2u : 1u;
+        if (dialect.schema_delims) {
+            if (tokens.size() != 3 + flag_fields) {
+                std::cerr << "For Multi-Valued CatNumerical you should specify Max or Min or MaxMin or TopK#k or BottomK#k or Weighted. and the delims(token delim and cat value delim)" << std::endl;
+                return -1;
+            }
+            column.delims[0] = tokens[1 + flag_fields].data[0];
+            column.delims[1] = tokens[2 + flag_fields].data[0];
+        } else {
+            if (tokens.size() != 1 + flag_fields) {
+                std::cerr << "For Multi-Valued CatNumerical you should specify Max or Min or MaxMin or TopK#k or BottomK#k or Weighted." << std::endl;
+                return -1;
+            }
+            column.delims[0] = ';';
+            column.delims[1] = ':';
+        }
+        if (parse_catnum_flag(tokens[1], column.catnum_flag) != 0) {
+            return -1;
+        }
+        if (flag_fields == 2u) {
+            if (!parse_count(tokens[2], column.catnum_k) || column.catnum_k == 0u) {
+                std::cerr << "For TopK#k and BottomK#k, k should be a number of at least 1."
+                          << std::endl;
+                return -1;
+            }
+        }
+    } else if (equals(line, "Label")) {
+        column.oflag = Oflag::LABEL;
+    } else if (starts_with(line, "Time")) {
+        auto tokens = split(line, '#');
+        if (tokens.size() != 2) {
+            std::cerr << "For Time you should specify a format." << std::endl;
+            return -1;
+        }
+        column.oflag = Oflag::TIME;
+        column.time_format = to_string(tokens[1]);
+        column.time_layout = compile_time_format(column.time_format);
+    } else if (equals(line, "Ignore")) {
+        column.oflag = Oflag::IGNORE;
+    } else {
+        std::cerr << "unknown flag: " << line << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+// Parses and compiles one schema line as the next column of `plan`.
+inline int add_feature_flag(StrView line, const CleanerDialect& dialect, ColumnPlan& plan) {
+    Column column;
+    column.index = plan.columns.size();
+    if (parse_feature_flag(line, dialect, column) != 0) {
+        return -1;
+    }
+    compile_column(dialect, plan, column);
+    add_row_slots(plan, column);
+    if (column.oflag == Oflag::LABEL) {
+        plan.label_column = column.index;
+    }
+    plan.columns.push_back(column);
+    return 0;
+}
+
+// Reads the schema file, one flag per line, and compiles it into `plan` for
+// the output options already set there (format, hash_space, ...).
+inline int parse_feature_flags(const char* filename, const CleanerDialect& dialect,
+        ColumnPlan& plan) {
+    if (filename == nullptr) {
+        std::cerr << "empty filename";
+        return -1;
+    }
+    FILE* file = fopen(filename, "r");
+
+    if (file == nullptr) {
+        std::cerr << "Open feature flags file [" << filename << "] failed.";
+        return -1;
+    }
+    FileLineReader flags_reader;
+    char* line = nullptr;
+    while (line = flags_reader.getline(file)) {
+        if (add_feature_flag({line, flags_reader.size()}, dialect, plan) != 0) {
+            fclose(file);
+            return -1;
+        }
+    }
+
+    fclose(file);
+    return 0;
+}
+
+inline LineContext line_context(ThreadContext& thread, SinkBuffers& out) {
+    return LineContext{thread.tokenizer, thread.time_cache, thread.rows, out.instances,
+        out.labels, out.diag(), thread.discard, thread.counters, thread.diagnosed, thread.stats,
+        thread.catnum_pairs, thread.item_signs, thread.features};
+}
+
+// The tokens of `line`; a field count that differs from the schema is
+// reported, tokens past its end are ignored by handle_columns.
+inline const std::vector<StrView>& split_columns(const ColumnPlan& plan, StrView line,
+        LineContext& ctx) {
+    const auto& tokens = ctx.tokenizer.split_line(line);
+    if (tokens.size() != plan.columns.size()) {
+        ctx.diagnose(DIAG_FIELD_COUNT) << "Error Line NF= " << tokens.size() << '\n';
+    }
+    return tokens;
+}
+
+inline void handle_columns(const ColumnPlan& plan, const std::vector<StrView>& tokens,
+        LineContext& ctx) {
+    const auto& columns = plan.columns;
+    size_t n = std::min(tokens.size(), columns.size());
+    for (size_t i = 0u; i < n; ++i) {
+        columns[i].handler(columns[i], tokens[i], i + 1 == tokens.size(), ctx);
+    }
+}
+
+// Writes the instance of one row: a text line, a binary row or a
+// libsvm/libffm line. With --sample-weight `weight` is written as well.
+inline void write_row(const ColumnPlan& plan, const std::vector<StrView>& tokens,
+        double weight, ThreadContext& thread, LineContext& ctx) {
+    bool sparse = plan.format == OUTPUT_LIBSVM || plan.format == OUTPUT_LIBFFM;
+    if (plan.format == OUTPUT_BINARY) {
+        thread.rows.begin();
+    } else if (sparse || plan.label_first) {
+        // lines without a label get 0.
+        if (plan.label_column < tokens.size()) {
+            ctx.out << tokens[plan.label_column];
+        } else {
+            ctx.out << '0';
+        }
+        if (sparse && plan.sample_weight) {
+            ctx.out << ':';
+            thread.weight_begin = ctx.out.size();
+            ctx.out << weight;
+            thread.weight_end = ctx.out.size();
+        }
+        if (!sparse) {
+            ctx.out << ODELIM;
+        }
+    }
+    handle_columns(plan, tokens, ctx);
+    if (plan.format == OUTPUT_BINARY) {
+        if (plan.sample_weight) {
+            thread.rows.put_double(plan.weight_slot, weight);
+        }
+        thread.rows.finish(ctx.out);
+        // the weight slot is the last one.
+        thread.weight_end = ctx.out.size();
+        thread.weight_begin = thread.weight_end - sizeof(double);
+    } else {
+        if (sparse) {
+            write_features(plan.format == OUTPUT_LIBFFM, ctx);
+        }
+        if (plan.sample_weight && !sparse) {
+            ctx.out << ODELIM;
+            thread.weight_begin = ctx.out.size();
+            ctx.out << weight;
+            thread.weight_end = ctx.out.size();
+        }
+        ctx.out << '\n';
+    }
+}
+
+// Whether the row survives --sample and --label-rates; `weight` is the
+// inverse of the rate it was kept at. Rows bound for the --reservoir are
+// cleaned into the thread's held buffers and handed to it with where their
+// weight is, which it rescales at the end; their diagnostics go out as
+// usual, the rows it skips are dropped here.
+inline bool sample_row(const ColumnPlan& plan, const std::vector<StrView>& tokens,
+        ThreadContext& thread, LineContext& ctx) {
+    RowSampler& sampler = *plan.sampler;
+    double rate = 1.0;
+    if (!sampler.keep(tokens, thread.sample_state, rate)) {
+        return false;
+    }
+    if (!sampler.has_reservoir()) {
+        sampler.count_kept();
+        write_row(plan, tokens, 1.0 / rate, thread, ctx);
+        return true;
+    }
+    size_t slot = sampler.reservoir_slot(thread.sample_state);
+    if (slot == RowSampler::NONE) {
+        return false;
+    }
+    thread.held_instance.clear();
+    thread.held_label.clear();
+    LineContext held = {ctx.tokenizer, ctx.time_cache, ctx.rows, thread.held_instance,
+        thread.held_label, ctx.diag, ctx.discard, ctx.counters, ctx.diagnosed, ctx.stats,
+        ctx.catnum_pairs, ctx.item_signs, ctx.features};
+    write_row(plan, tokens, 1.0 / rate, thread, held);
+    if (!plan.sample_weight) {
+        thread.weight_begin = thread.weight_end = 0u;
+    }
+    sampler.hold(slot, thread.held_instance, thread.held_label, rate, thread.weight_begin,
+            thread.weight_end);
+    return true;
+}
+
+// Cleans one input line: the instance goes to `out.instances`, the label to
+// `out.labels` and diagnostics to `out.diag()`. With --dedup a row seen
+// before writes nothing, nor does a row sampling drops; false for those.
+// A row held by the --reservoir counts as written.
+inline bool clean_line(const ColumnPlan& plan, StrView line, ThreadContext& thread,
+        SinkBuffers& out) {
+    LineContext ctx = line_context(thread, out);
+    size_t out_size = 0u;
+    if (thread.stats != nullptr) {
+        out_size = out.instances.size() + out.labels.size();
+    }
+    const auto& tokens = split_columns(plan, line, ctx);
+    bool duplicate = plan.dedup != nullptr && plan.dedup->is_duplicate(line, tokens);
+    bool sampled_out = false;
+    if (!duplicate && plan.sampler != nullptr) {
+        sampled_out = !sample_row(plan, tokens, thread, ctx);
+    } else if (!duplicate) {
+        write_row(plan, tokens, 1.0, thread, ctx);
+    }
+    if (thread.stats != nullptr) {
+        bump(thread.stats->rows);
+        bump(thread.stats->duplicates, duplicate);
+        bump(thread.stats->sampled_out, sampled_out);
+        bump(thread.stats->bytes_in, line.size + 1u);
+        bump(thread.stats->bytes_out, out.instances.size() + out.labels.size() - out_size);
+    }
+    return !duplicate && !sampled_out;
+}
+
+#endif // DATA_CLEANER_COLUMN_PLAN_H
@@ -0,0 +1,339 @@
+#ifndef DATA_CLEANER_COLUMN_PROFILE_H
+#define DATA_CLEANER_COLUMN_PROFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "MurmurHash3.h"
+#include "column_plan.h"
+#include "hyperloglog.h"
+#include "output_buffer.h"
+#include "output_sinks.h"
+#include "quantile_sketch.h"
+#include "space_saving.h"
+#include "str_view.h"
+
+// Multi-Valued lists of LIST_LENGTHS or more items share the last bin.
+const size_t LIST_LENGTHS = 32u;
+const size_t PROFILE_TOP = 10u;
+
+// What --profile learns about one column. Every part has a fixed size, so
+// a profile costs the same whatever the size of the input.
+struct ColumnProfile {
+    uint64_t cells = 0u;
+    uint64_t empties = 0u;
+    uint64_t nulls = 0u;
+    // empty or null cells, the null_rate; empty counts even where the column
+    // does not take it for null.
+    uint64_t missing = 0u;
+    // values that are no number or time, or CAT:VALUE pairs that are broken.
+    uint64_t failures = 0u;
+    // distinct and most frequent values, items of Multi-Valued columns.
+    HyperLogLog distinct;
+    SpaceSaving top;
+    // Numerical and Time values, and the values of CAT:VALUE pairs; NaN and
+    // infinities are only counted, in non_finite.
+    uint64_t numbers = 0u;
+    uint64_t non_finite = 0u;
+    double min = std::numeric_limits<double>::max();
+    double max = std::numeric_limits<double>::lowest();
+    double sum = 0.0;
+    QuantileSketch quantiles;
+    std::vector<uint64_t> lengths;
+
+    void add_value(StrView value) {
+        uint64_t hash = MurmurHash64A(value.data, value.size, SIGN_SEED);
+        distinct.add(hash);
+        top.add(hash, value);
+    }
+
+    void add_number(double value) {
+        if (!std::isfinite(value)) {
+            ++non_finite;
+            return;
+        }
+        ++numbers;
+        min = std::min(min, value);
+        max = std::max(max, value);
+        sum += value;
+        quantiles.add(value);
+    }
+
+    void add_length(size_t length) {
+        if (lengths.empty()) {
+            lengths.resize(LIST_LENGTHS + 1u);
+        }
+        ++lengths[std::min(length, LIST_LENGTHS)];
+    }
+
+    void merge(const ColumnProfile& other) {
+        cells += other.cells;
+        empties += other.empties;
+        nulls += other.nulls;
+        missing += other.missing;
+        failures += other.failures;
+        distinct.merge(other.distinct);
+        top.merge(other.top);
+        numbers += other.numbers;
+        non_finite += other.non_finite;
+        min = std::min(min, other.min);
+        max = std::max(max, other.max);
+        sum += other.sum;
+        quantiles.merge(other.quantiles);
+        if (!other.lengths.empty()) {
+            lengths.resize(LIST_LENGTHS + 1u);
+            for (size_t i = 0u; i < lengths.size(); ++i) {
+                lengths[i] += other.lengths[i];
+            }
+        }
+    }
+};
+
+// The profiles of one worker.
+struct ThreadProfile {
+    explicit ThreadProfile(size_t columns) : columns(columns) {}
+
+    std::vector<ColumnProfile> columns;
+    uint64_t rows = 0u;
+    uint64_t field_count_errors = 0u;
+};
+
+inline void write_json_string(OutputBuffer& out, StrView str) {
+    out << '"';
+    for (size_t i = 0u; i < str.size; ++i) {
+        unsigned char c = static_cast<unsigned char>(str.data[i]);
+        if (c == '"' || c == '\\') {
+            out << '\\' << static_cast<char>(c);
+        } else if (c < 0x20u) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out << escaped;
+        } else {
+            out << static_cast<char>(c);
+        }
+    }
+    out << '"';
+}
+
+// JSON has no NaN or infinity.
+inline void write_json_number(OutputBuffer& out, double value) {
+    if (std::isfinite(value)) {
+        out << value;
+    } else {
+        out << "null";
+    }
+}
+
+// The profiles of a --profile run: every worker fills a set of its own and
+// they are merged into the report at the end.
+class Profiler {
+public:
+    explicit Profiler(const ColumnPlan& plan) : _plan(plan) {}
+
+    const ColumnPlan& plan() const {
+        return _plan;
+    }
+
+    ThreadProfile* add_thread() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _threads.emplace_back(new ThreadProfile(_plan.columns.size()));
+        return _threads.back().get();
+    }
+
+    // One JSON object: the row count and, per schema column, its null rate,
+    // distinct count, top values, numeric range and quantiles, failure rate
+    // and the length distribution of Multi-Valued lists.
+    void write_json(OutputBuffer& out) {
+        ThreadProfile total(_plan.columns.size());
+        for (const auto& thread : _threads) {
+            total.rows += thread->rows;
+            total.field_count_errors += thread->field_count_errors;
+            for (size_t i = 0u; i < total.columns.size(); ++i) {
+                total.columns[i].merge(thread->columns[i]);
+            }
+        }
+        auto rate = [](uint64_t count, uint64_t of) {
+            return of == 0u ? 0.0 : static_cast<double>(count) / of;
+        };
+        out << "{\"rows\":" << total.rows << ",\"field_count_errors\":"
+            << total.field_count_errors << ",\"columns\":[";
+        for (size_t i = 0u; i < total.columns.size(); ++i) {
+            const Column& column = _plan.columns[i];
+            const ColumnProfile& p = total.columns[i];
+            out << (i ? "," : "") << "{\"index\":" << column.index << ",\"type\":\""
+                << oflag_name(column.oflag) << "\",\"cells\":" << p.cells << ",\"empty\":"
+                << p.empties << ",\"null\":" << p.nulls << ",\"null_rate\":"
+                << rate(p.missing, p.cells) << ",\"distinct\":" << p.distinct.estimate()
+                << ",\"top\":[";
+            auto top = p.top.top(PROFILE_TOP);
+            for (size_t t = 0u; t < top.size(); ++t) {
+                out << (t ? "," : "") << "{\"value\":";
+                write_json_string(out, StrView{top[t].text.data(), top[t].text.size()});
+                out << ",\"count\":" << top[t].count << ",\"error\":" << top[t].error << '}';
+            }
+            out << ']';
+            if (p.numbers != 0u) {
+                out << ",\"numbers\":" << p.numbers << ",\"min\":";
+                write_json_number(out, p.min);
+                out << ",\"max\":";
+                write_json_number(out, p.max);
+                out << ",\"mean\":";
+                write_json_number(out, p.sum / p.numbers);
+                out << ",\"quantiles\":{";
+                static const double QUANTILES[] = {0.01, 0.25, 0.5, 0.75, 0.99};
+                static const char* const NAMES[] = {"p01", "p25", "p50", "p75", "p99"};
+                for (size_t q = 0u; q < 5u; ++q) {
+                    out << (q ? ",\"" : "\"") << NAMES[q] << "\":";
+                    write_json_number(out, p.quantiles.quantile(QUANTILES[q]));
+                }
+                out << '}';
+            }
+            out << ",\"failures\":" << p.failures << ",\"failure_rate\":"
+                << rate(p.failures, p.cells - p.nulls) << ",\"non_finite\":" << p.non_finite;
+            if (!p.lengths.empty()) {
+                out << ",\"list_length\":[";
+                for (size_t l = 0u; l < p.lengths.size(); ++l) {
+                    out << (l ? "," : "") << p.lengths[l];
+                }
+                out << ']';
+            }
+            out << '}';
+        }
+        out << "]}\n";
+    }
+
+    int write_file(const std::string& path) {
+        OutputBuffer json;
+        write_json(json);
+        std::string tmp = path + ".tmp";
+        FILE* file = fopen(tmp.c_str(), "w");
+        if (file == nullptr) {
+            std::cerr << "Open profile file [" << tmp << "] failed." << std::endl;
+            return -1;
+        }
+        bool ok = fwrite(json.data(), 1, json.size(), file) == json.size();
+        ok = (fclose(file) == 0) && ok;
+        if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+            std::cerr << "write profile file [" << path << "] failed." << std::endl;
+            remove(tmp.c_str());
+            return -1;
+        }
+        return 0;
+    }
+
+private:
+    const ColumnPlan& _plan;
+    std::mutex _mutex;
+    std::vector<std::unique_ptr<ThreadProfile>> _threads;
+};
+
+// One worker of the profiling pass. It tokenizes and parses times like the
+// cleaner, through a ThreadContext of its own, so failures are diagnosed as
+// a cleaning run would; like ThreadContext every copy gets profiles of its
+// own. Ignore columns are profiled too, so the tokenizer splits every field.
+struct ProfileContext {
+    ProfileContext(Profiler& profiler, DiagnosticCounters& counters)
+        : profiler(profiler), thread(profiler.plan(), counters),
+          profile(profiler.add_thread()) {
+        thread.tokenizer.project(std::vector<bool>());
+    }
+
+    ProfileContext(const ProfileContext& other)
+        : profiler(other.profiler), thread(other.thread), profile(profiler.add_thread()) {}
+
+    void add_line(StrView line, SinkBuffers& out) {
+        const ColumnPlan& plan = profiler.plan();
+        LineContext ctx = line_context(thread, out);
+        const auto& tokens = split_columns(plan, line, ctx);
+        ++profile->rows;
+        if (tokens.size() != plan.columns.size()) {
+            ++profile->field_count_errors;
+        }
+        size_t n = std::min(tokens.size(), plan.columns.size());
+        for (size_t i = 0u; i < n; ++i) {
+            add_cell(plan.columns[i], tokens[i], ctx, profile->columns[i]);
+        }
+    }
+
+    void add_cell(const Column& column, StrView token, LineContext& ctx, ColumnProfile& p) {
+        ++p.cells;
+        bool null = is_null(column, token);
+        if (token.size == 0u) {
+            ++p.empties;
+        }
+        if (token.size == 0u || null) {
+            ++p.missing;
+        }
+        if (null) {
+            ++p.nulls;
+            return;
+        }
+        switch (column.oflag) {
+        case Oflag::NUM:
+        case Oflag::NUM_BUCKET: {
+            p.add_value(token);
+            double value = 0.0;
+            if (!parse_number(token, value)) {
+                ++p.failures;
+            } else {
+                p.add_number(value);
+            }
+            break;
+        }
+        case Oflag::TIME: {
+            p.add_value(token);
+            uint64_t diagnosed = thread.diagnosed;
+            time_t t = parse_time(column, token, ctx) - column.time_offset;
+            if (thread.diagnosed != diagnosed) {
+                ++p.failures;
+            } else {
+                p.add_number(static_cast<double>(t));
+            }
+            break;
+        }
+        case Oflag::MULTI_CAT: {
+            const auto& items = ctx.tokenizer.split_field(token, column.delims[0]);
+            p.add_length(items.size());
+            for (const auto& item : items) {
+                p.add_value(item);
+            }
+            break;
+        }
+        case Oflag::MULTI_CAT_NUM: {
+            const auto& items = ctx.tokenizer.split_field(token, column.delims[0]);
+            p.add_length(items.size());
+            bool failed = false;
+            for (const auto& item : items) {
+                StrView key, number;
+                size_t parts = split_pair(item, column.delims[1], key, number);
+                p.add_value(key);
+                double value = 0.0;
+                if (parts != 2u || !parse_number(number, value)) {
+                    failed = true;
+                } else {
+                    p.add_number(value);
+                }
+            }
+            p.failures += failed;
+            break;
+        }
+        default:
+            p.add_value(token);
+            break;
+        }
+    }
+
+    Profiler& profiler;
+    ThreadContext thread;
+    ThreadProfile* profile;
+};
+
+#endif // DATA_CLEANER_COLUMN_PROFILE_H
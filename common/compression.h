@@ -0,0 +1,510 @@
+#ifndef DATA_CLEANER_COMPRESSION_H
+#define DATA_CLEANER_COMPRESSION_H
+
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef DATA_CLEANER_ZSTD
+#include <zstd.h>
+#endif
+
+#include "output_buffer.h"
+
+// gzip is always available; zstd needs -DDATA_CLEANER_ZSTD and -lzstd.
+enum Compression : int {
+    COMPRESS_NONE = 0,
+    COMPRESS_GZIP = 1,
+    COMPRESS_ZSTD = 2
+};
+
+inline Compression detect_compression(const char* data, size_t size) {
+    static const unsigned char GZIP_MAGIC[] = {0x1f, 0x8b};
+    static const unsigned char ZSTD_MAGIC[] = {0x28, 0xb5, 0x2f, 0xfd};
+    if (size >= sizeof(GZIP_MAGIC) && memcmp(data, GZIP_MAGIC, sizeof(GZIP_MAGIC)) == 0) {
+        return COMPRESS_GZIP;
+    }
+    if (size >= sizeof(ZSTD_MAGIC) && memcmp(data, ZSTD_MAGIC, sizeof(ZSTD_MAGIC)) == 0) {
+        return COMPRESS_ZSTD;
+    }
+    return COMPRESS_NONE;
+}
+
+inline int parse_compression(const char* name, Compression& compression) {
+    if (strcmp(name, "none") == 0) {
+        compression = COMPRESS_NONE;
+    } else if (strcmp(name, "gzip") == 0) {
+        compression = COMPRESS_GZIP;
+    } else if (strcmp(name, "zstd") == 0) {
+        compression = COMPRESS_ZSTD;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+inline bool compression_supported(Compression compression) {
+#ifdef DATA_CLEANER_ZSTD
+    return true;
+#else
+    if (compression == COMPRESS_ZSTD) {
+        std::cerr << "zstd support is not compiled in, build with -DDATA_CLEANER_ZSTD -lzstd"
+                  << std::endl;
+        return false;
+    }
+    return true;
+#endif
+}
+
+// Bounded single producer / single consumer queue of data blocks between a
+// codec thread and the cleaner. Consumed blocks are handed back through
+// recycle() so the ring of blocks is allocated once.
+class BlockQueue {
+public:
+    explicit BlockQueue(size_t depth) : _depth(depth) {}
+
+    // a block to fill, empty but with its old capacity.
+    std::string acquire() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::string block;
+        if (!_free.empty()) {
+            block.swap(_free.back());
+            _free.pop_back();
+        }
+        block.clear();
+        return block;
+    }
+
+    void recycle(std::string& block) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _free.push_back(std::string());
+        _free.back().swap(block);
+    }
+
+    // blocks while the queue is full; false once the consumer has closed it.
+    bool push(std::string& block) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cv.wait(lock, [this] { return _blocks.size() < _depth || _closed; });
+        if (_closed) {
+            return false;
+        }
+        _blocks.push_back(std::string());
+        _blocks.back().swap(block);
+        lock.unlock();
+        _cv.notify_all();
+        return true;
+    }
+
+    // blocks until a block arrives; false once closed and drained.
+    bool pop(std::string& block) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cv.wait(lock, [this] { return !_blocks.empty() || _closed; });
+        if (_blocks.empty()) {
+            return false;
+        }
+        block.swap(_blocks.front());
+        _blocks.pop_front();
+        lock.unlock();
+        _cv.notify_all();
+        return true;
+    }
+
+    // ends the stream; called by the producer when it is done and by the
+    // consumer to stop it early.
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _closed = true;
+        }
+        _cv.notify_all();
+    }
+
+private:
+    const size_t _depth;
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    std::deque<std::string> _blocks;
+    std::vector<std::string> _free;
+    bool _closed = false;
+};
+
+// Compressed bytes either from a file descriptor, starting with `prefix`
+// that was already read from it, or from memory such as a mapped file.
+class RawInput {
+public:
+    RawInput(int fd, std::string prefix) : _fd(fd), _prefix(std::move(prefix)) {}
+    RawInput(const char* data, size_t size) : _data(data), _size(size) {}
+
+    // the next span of input; size 0 at the end, -1 on a read error.
+    int next(const char*& data, size_t& size) {
+        if (_fd < 0) {
+            data = _data;
+            size = _size;
+            _size = 0u;
+            return 0;
+        }
+        if (!_prefix.empty()) {
+            _buffer.swap(_prefix);
+            _prefix.clear();
+        } else {
+            _buffer.resize(BLOCK_SIZE);
+            ssize_t ret = 0;
+            while ((ret = ::read(_fd, &_buffer[0], _buffer.size())) < 0 && errno == EINTR) {
+            }
+            if (ret < 0) {
+                std::cerr << "read compressed input failed." << std::endl;
+                return -1;
+            }
+            _buffer.resize(ret);
+        }
+        data = _buffer.data();
+        size = _buffer.size();
+        return 0;
+    }
+
+    static const size_t BLOCK_SIZE = 1u << 20;
+
+private:
+    int _fd = -1;
+    std::string _prefix;
+    std::string _buffer;
+    const char* _data = nullptr;
+    size_t _size = 0u;
+};
+
+// Decompresses on its own thread into a BlockQueue and exposes the result
+// as a FILE*, so FileLineReader and the chunk pipeline read it like stdin.
+class CompressedInput {
+public:
+    CompressedInput(Compression compression, RawInput input)
+        : _compression(compression), _input(std::move(input)), _queue(QUEUE_DEPTH) {}
+
+    CompressedInput(const CompressedInput&) = delete;
+    CompressedInput& operator=(const CompressedInput&) = delete;
+
+    ~CompressedInput() {
+        close();
+    }
+
+    FILE* open() {
+        cookie_io_functions_t io = {};
+        io.read = &CompressedInput::read_cookie;
+        _stream = fopencookie(this, "r", io);
+        if (_stream == nullptr) {
+            std::cerr << "open decompression stream failed." << std::endl;
+            return nullptr;
+        }
+        _thread = std::thread(&CompressedInput::decode, this);
+        return _stream;
+    }
+
+    // stops the decoder; -1 if the input was corrupt or unreadable.
+    int close() {
+        _queue.close();
+        if (_thread.joinable()) {
+            _thread.join();
+        }
+        if (_stream != nullptr) {
+            fclose(_stream);
+            _stream = nullptr;
+        }
+        return _status;
+    }
+
+private:
+    static const size_t QUEUE_DEPTH = 8u;
+
+    static ssize_t read_cookie(void* cookie, char* buf, size_t size) {
+        CompressedInput* self = static_cast<CompressedInput*>(cookie);
+        while (self->_offset == self->_block.size()) {
+            self->_queue.recycle(self->_block);
+            self->_offset = 0u;
+            if (!self->_queue.pop(self->_block)) {
+                return 0;
+            }
+        }
+        size_t n = std::min(size, self->_block.size() - self->_offset);
+        memcpy(buf, self->_block.data() + self->_offset, n);
+        self->_offset += n;
+        return n;
+    }
+
+    void decode() {
+        int ret = _compression == COMPRESS_GZIP ? inflate_gzip() : decompress_zstd();
+        if (ret != 0) {
+            _status = -1;
+        }
+        _queue.close();
+    }
+
+    // hands `block` to the reader once it is full or `force`d.
+    bool emit(std::string& block, bool force) {
+        if (block.empty() || (!force && block.size() < RawInput::BLOCK_SIZE)) {
+            return true;
+        }
+        if (!_queue.push(block)) {
+            return false;
+        }
+        block = _queue.acquire();
+        return true;
+    }
+
+    int inflate_gzip() {
+        z_stream zs = {};
+        // 32: accept gzip and zlib headers.
+        if (inflateInit2(&zs, 15 + 32) != Z_OK) {
+            std::cerr << "inflateInit failed." << std::endl;
+            return -1;
+        }
+        std::string block = _queue.acquire();
+        int ret = Z_OK;
+        const char* data = nullptr;
+        size_t size = 0u;
+        while (_input.next(data, size) == 0 && size > 0u) {
+            zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+            zs.avail_in = size;
+            while (zs.avail_in > 0u) {
+                // concatenated gzip members, as written by `cat a.gz b.gz`.
+                if (ret == Z_STREAM_END && inflateReset(&zs) != Z_OK) {
+                    ret = Z_DATA_ERROR;
+                    break;
+                }
+                size_t offset = block.size();
+                block.resize(RawInput::BLOCK_SIZE);
+                zs.next_out = reinterpret_cast<Bytef*>(&block[offset]);
+                zs.avail_out = block.size() - offset;
+                ret = inflate(&zs, Z_NO_FLUSH);
+                block.resize(block.size() - zs.avail_out);
+                if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+                    break;
+                }
+                if (!emit(block, false)) {
+                    inflateEnd(&zs);
+                    return 0;
+                }
+            }
+            if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+                break;
+            }
+        }
+        inflateEnd(&zs);
+        emit(block, true);
+        if (ret != Z_STREAM_END) {
+            std::cerr << "gzip input is corrupt or truncated." << std::endl;
+            return -1;
+        }
+        return 0;
+    }
+
+    int decompress_zstd() {
+#ifdef DATA_CLEANER_ZSTD
+        ZSTD_DStream* zs = ZSTD_createDStream();
+        if (zs == nullptr || ZSTD_isError(ZSTD_initDStream(zs))) {
+            std::cerr << "ZSTD_initDStream failed." << std::endl;
+            ZSTD_freeDStream(zs);
+            return -1;
+        }
+        std::string block = _queue.acquire();
+        size_t ret = 0u;
+        const char* data = nullptr;
+        size_t size = 0u;
+        while (_input.next(data, size) == 0 && size > 0u) {
+            ZSTD_inBuffer in = {data, size, 0u};
+            while (in.pos < in.size) {
+                size_t offset = block.size();
+                block.resize(RawInput::BLOCK_SIZE);
+                ZSTD_outBuffer out = {&block[0], block.size(), offset};
+                ret = ZSTD_decompressStream(zs, &out, &in);
+                block.resize(out.pos);
+                if (ZSTD_isError(ret)) {
+                    std::cerr << "zstd input is corrupt: " << ZSTD_getErrorName(ret)
+                              << std::endl;
+                    ZSTD_freeDStream(zs);
+                    return -1;
+                }
+                if (!emit(block, false)) {
+                    ZSTD_freeDStream(zs);
+                    return 0;
+                }
+            }
+        }
+        ZSTD_freeDStream(zs);
+        emit(block, true);
+        // a non zero hint means the last frame is incomplete.
+        if (ret != 0u) {
+            std::cerr << "zstd input is truncated." << std::endl;
+            return -1;
+        }
+        return 0;
+#else
+        return -1;
+#endif
+    }
+
+    const Compression _compression;
+    RawInput _input;
+    BlockQueue _queue;
+    std::thread _thread;
+    FILE* _stream = nullptr;
+    std::string _block;
+    size_t _offset = 0u;
+    int _status = 0;
+};
+
+// Compresses the blocks written to one output file on its own thread.
+class CompressedOutput {
+public:
+    CompressedOutput(int fd, Compression compression, int level)
+        : _fd(fd), _compression(compression), _level(level), _queue(QUEUE_DEPTH) {
+        _thread = std::thread(&CompressedOutput::encode, this);
+    }
+
+    CompressedOutput(const CompressedOutput&) = delete;
+    CompressedOutput& operator=(const CompressedOutput&) = delete;
+
+    ~CompressedOutput() {
+        close();
+    }
+
+    // queues the contents of `buffer` and empties it.
+    int write(OutputBuffer& buffer) {
+        if (buffer.size() == 0u) {
+            return 0;
+        }
+        std::string block = _queue.acquire();
+        block.assign(buffer.data(), buffer.size());
+        buffer.clear();
+        return _queue.push(block) ? 0 : -1;
+    }
+
+    // finishes the compressed stream; -1 if compressing or writing failed.
+    int close() {
+        _queue.close();
+        if (_thread.joinable()) {
+            _thread.join();
+        }
+        return _status;
+    }
+
+private:
+    static const size_t QUEUE_DEPTH = 4u;
+    static const size_t OUT_SIZE = 1u << 18;
+
+    void encode() {
+        int ret = _compression == COMPRESS_GZIP ? deflate_gzip() : compress_zstd();
+        if (ret != 0) {
+            _status = -1;
+            // unblock the cleaner, the rest of its output is dropped.
+            _queue.close();
+            std::string block;
+            while (_queue.pop(block)) {
+            }
+        }
+    }
+
+    int write_all(const char* data, size_t size) {
+        while (size > 0u) {
+            ssize_t ret = ::write(_fd, data, size);
+            if (ret < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                std::cerr << "write compressed output failed." << std::endl;
+                return -1;
+            }
+            data += ret;
+            size -= ret;
+        }
+        return 0;
+    }
+
+    int deflate_gzip() {
+        z_stream zs = {};
+        // 16: write a gzip header and trailer.
+        if (deflateInit2(&zs, _level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            std::cerr << "deflateInit failed." << std::endl;
+            return -1;
+        }
+        std::string out(OUT_SIZE, '\0');
+        std::string block;
+        bool more = true;
+        while (more) {
+            more = _queue.pop(block);
+            zs.next_in = reinterpret_cast<Bytef*>(&block[0]);
+            zs.avail_in = more ? block.size() : 0u;
+            int flush = more ? Z_NO_FLUSH : Z_FINISH;
+            int ret = Z_OK;
+            do {
+                zs.next_out = reinterpret_cast<Bytef*>(&out[0]);
+                zs.avail_out = out.size();
+                ret = deflate(&zs, flush);
+                if (ret == Z_STREAM_ERROR ||
+                        write_all(out.data(), out.size() - zs.avail_out) != 0) {
+                    deflateEnd(&zs);
+                    return -1;
+                }
+            } while (zs.avail_out == 0u || (flush == Z_FINISH && ret != Z_STREAM_END));
+            if (more) {
+                _queue.recycle(block);
+            }
+        }
+        deflateEnd(&zs);
+        return 0;
+    }
+
+    int compress_zstd() {
+#ifdef DATA_CLEANER_ZSTD
+        ZSTD_CStream* zs = ZSTD_createCStream();
+        if (zs == nullptr || ZSTD_isError(ZSTD_initCStream(zs, _level))) {
+            std::cerr << "ZSTD_initCStream failed." << std::endl;
+            ZSTD_freeCStream(zs);
+            return -1;
+        }
+        std::string out(ZSTD_CStreamOutSize(), '\0');
+        std::string block;
+        while (_queue.pop(block)) {
+            ZSTD_inBuffer in = {block.data(), block.size(), 0u};
+            while (in.pos < in.size) {
+                ZSTD_outBuffer o = {&out[0], out.size(), 0u};
+                size_t ret = ZSTD_compressStream(zs, &o, &in);
+                if (ZSTD_isError(ret) || write_all(out.data(), o.pos) != 0) {
+                    ZSTD_freeCStream(zs);
+                    return -1;
+                }
+            }
+            _queue.recycle(block);
+        }
+        size_t remaining = 0u;
+        do {
+            ZSTD_outBuffer o = {&out[0], out.size(), 0u};
+            remaining = ZSTD_endStream(zs, &o);
+            if (ZSTD_isError(remaining) || write_all(out.data(), o.pos) != 0) {
+                ZSTD_freeCStream(zs);
+                return -1;
+            }
+        } while (remaining != 0u);
+        ZSTD_freeCStream(zs);
+        return 0;
+#else
+        return -1;
+#endif
+    }
+
+    const int _fd;
+    const Compression _compression;
+    const int _level;
+    BlockQueue _queue;
+    std::thread _thread;
+    int _status = 0;
+};
+
+#endif // DATA_CLEANER_COMPRESSION_H
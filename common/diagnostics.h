@@ -0,0 +1,59 @@
+#ifndef DATA_CLEANER_DIAGNOSTICS_H
+#define DATA_CLEANER_DIAGNOSTICS_H
+
+#include <stdint.h>
+#include <atomic>
+#include <limits>
+
+#include "output_buffer.h"
+
+// Every kind of per line problem the cleaner reports.
+enum DiagKind : int {
+    DIAG_FIELD_COUNT = 0,   // "Error Line NF= "
+    DIAG_CATNUM_PAIR = 1,   // "There should be CAT:VALUE ..."
+    DIAG_NUMBER = 2,        // "error value format ..."
+    DIAG_TIME = 3,          // "fail to covert time..."
+    DIAG_KIND_COUNT = 4
+};
+
+static const char* const DIAG_NAMES[DIAG_KIND_COUNT] = {
+    "field count", "CAT:VALUE", "value format", "time format"};
+
+// Counts diagnostics by kind over all workers and lets only the first
+// `limit` of each kind through to the diagnostics sink.
+class DiagnosticCounters {
+public:
+    explicit DiagnosticCounters(uint64_t limit = std::numeric_limits<uint64_t>::max())
+        : _limit(limit) {
+        for (auto& count : _counts) {
+            count.store(0u, std::memory_order_relaxed);
+        }
+    }
+
+    // counts one diagnostic; false if it is over the limit.
+    bool report(DiagKind kind) {
+        return _counts[kind].fetch_add(1u, std::memory_order_relaxed) < _limit;
+    }
+
+    uint64_t count(DiagKind kind) const {
+        return _counts[kind].load(std::memory_order_relaxed);
+    }
+
+    // one line per kind that went over the limit.
+    void write_summary(OutputBuffer& out) const {
+        for (int kind = 0; kind < DIAG_KIND_COUNT; ++kind) {
+            uint64_t count = this->count(static_cast<DiagKind>(kind));
+            if (count > _limit) {
+                out << "suppressed " << static_cast<unsigned long long>(count - _limit)
+                    << " of " << static_cast<unsigned long long>(count) << " ["
+                    << DIAG_NAMES[kind] << "] diagnostics\n";
+            }
+        }
+    }
+
+private:
+    std::atomic<uint64_t> _counts[DIAG_KIND_COUNT];
+    const uint64_t _limit;
+};
+
+#endif // DATA_CLEANER_DIAGNOSTICS_H
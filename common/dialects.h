@@ -0,0 +1,39 @@
+#ifndef DATA_CLEANER_DIALECTS_H
+#define DATA_CLEANER_DIALECTS_H
+
+#include "column_plan.h"
+
+// The dialects of the three data_clean front ends, shared with the library.
+
+// data_clean: Numerical values are written as value + 0.5 and Time as
+// timestamp + 50.
+inline CleanerDialect root_dialect() {
+    CleanerDialect dialect;
+    dialect.schema_delims = false;
+    dialect.parse_numerical = true;
+    dialect.num_offset = 0.5;
+    dialect.time_offset = 50;
+    dialect.catnum_diag_column = true;
+    return dialect;
+}
+
+// data_cleaning: only "null" means missing, except for Multi-Valued
+// CatNumerical and Time where an empty token does too; a missing CatNumerical
+// is a single NaN. Time is written as timestamp + 15.
+inline CleanerDialect cleaning_dialect() {
+    CleanerDialect dialect;
+    dialect.schema_delims = false;
+    dialect.time_offset = 15;
+    dialect.empty_is_null = false;
+    dialect.pad_catnum_nulls = false;
+    dialect.catnum_diag_column = true;
+    return dialect;
+}
+
+// data_format: Multi-Valued delimiters come from the schema, values are
+// written as is.
+inline CleanerDialect format_dialect() {
+    return CleanerDialect();
+}
+
+#endif // DATA_CLEANER_DIALECTS_H
@@ -0,0 +1,88 @@
+#ifndef DATA_CLEANER_FILE_LINE_READER_H
+#define DATA_CLEANER_FILE_LINE_READER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <algorithm>
+#include <cstring>
+
+class FileLineReader {
+public:
+    ~FileLineReader() {
+        free(_buffer);
+        free(_more);
+    }
+
+    // With `quoted` a line is an RFC 4180 record: while it ends between
+    // double quotes the next line is part of it, newline included, and a
+    // trailing '\r' is dropped.
+    char* getline(FILE* file, bool quoted = false) {
+        if (file == nullptr) {
+            return nullptr;
+        }
+        char delim = '\n';
+        ssize_t ret = ::getdelim(&_buffer, &_capacity, delim, file);
+        if (ret <= 0) {
+            _size = 0;
+            return nullptr;
+        }
+        _consumed += ret;
+        if (_buffer[ret - 1] == delim) {
+            _buffer[ret - 1] = '\0';
+            _size = ret - 1;
+        } else {
+            _size = ret;
+        }
+        if (quoted) {
+            bool terminated = _size + 1u == static_cast<size_t>(ret);
+            size_t quotes = std::count(_buffer, _buffer + _size, '"');
+            while (quotes % 2u != 0u && terminated) {
+                ssize_t more = ::getdelim(&_more, &_more_capacity, delim, file);
+                if (more <= 0) {
+                    break;
+                }
+                _consumed += more;
+                terminated = _more[more - 1] == delim;
+                size_t length = more - terminated;
+                quotes += std::count(_more, _more + length, '"');
+                if (_capacity < _size + length + 2u) {
+                    _capacity = (_size + length + 2u) * 2u;
+                    _buffer = static_cast<char*>(realloc(_buffer, _capacity));
+                }
+                _buffer[_size++] = delim;
+                memcpy(_buffer + _size, _more, length);
+                _size += length;
+                _buffer[_size] = '\0';
+            }
+            if (_size > 0u && _buffer[_size - 1] == '\r') {
+                _buffer[--_size] = '\0';
+            }
+        }
+        return _buffer;
+    }
+
+    char* buffer() {
+        return _buffer;
+    }
+
+    size_t size() {
+        return _size;
+    }
+
+    // input bytes the lines returned so far took, newlines included.
+    uint64_t consumed() const {
+        return _consumed;
+    }
+
+private:
+    char* _buffer = nullptr;
+    size_t _capacity = 0u;
+    size_t _size = 0u;
+    char* _more = nullptr;
+    size_t _more_capacity = 0u;
+    uint64_t _consumed = 0u;
+};
+
+#endif // DATA_CLEANER_FILE_LINE_READER_H
@@ -0,0 +1,51 @@
+#ifndef DATA_CLEANER_HYPERLOGLOG_H
+#define DATA_CLEANER_HYPERLOGLOG_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// HyperLogLog distinct counter over 64 bit hashes: 2^12 one byte registers,
+// a standard error of about 1.6%, with the linear counting correction for
+// small cardinalities. Counters merge by taking the larger register.
+class HyperLogLog {
+public:
+    static const unsigned PRECISION = 12u;
+
+    HyperLogLog() : _registers(size_t(1u) << PRECISION, 0u) {}
+
+    void add(uint64_t hash) {
+        size_t index = hash >> (64u - PRECISION);
+        // the marker bit bounds the rank when the remaining bits are zero.
+        uint64_t rest = (hash << PRECISION) | (uint64_t(1u) << (PRECISION - 1u));
+        uint8_t rank = static_cast<uint8_t>(__builtin_clzll(rest) + 1);
+        _registers[index] = std::max(_registers[index], rank);
+    }
+
+    void merge(const HyperLogLog& other) {
+        for (size_t i = 0u; i < _registers.size(); ++i) {
+            _registers[i] = std::max(_registers[i], other._registers[i]);
+        }
+    }
+
+    uint64_t estimate() const {
+        double m = static_cast<double>(_registers.size());
+        double sum = 0.0;
+        size_t zeros = 0u;
+        for (uint8_t r : _registers) {
+            sum += std::ldexp(1.0, -r);
+            zeros += r == 0u;
+        }
+        double estimate = 0.7213 / (1.0 + 1.079 / m) * m * m / sum;
+        if (estimate <= 2.5 * m && zeros != 0u) {
+            estimate = m * std::log(m / zeros);
+        }
+        return static_cast<uint64_t>(estimate + 0.5);
+    }
+
+private:
+    std::vector<uint8_t> _registers;
+};
+
+#endif // DATA_CLEANER_HYPERLOGLOG_H
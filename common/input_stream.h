@@ -0,0 +1,108 @@
+#ifndef DATA_CLEANER_INPUT_STREAM_H
+#define DATA_CLEANER_INPUT_STREAM_H
+
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "compression.h"
+
+// The input of the stream paths as a FILE*. stdin is sniffed for a gzip or
+// zstd header and, if it has one, decompressed on a separate thread; a
+// mapped --input file found to be compressed takes the same route.
+class InputStream {
+public:
+    InputStream() = default;
+    InputStream(const InputStream&) = delete;
+    InputStream& operator=(const InputStream&) = delete;
+
+    ~InputStream() {
+        close();
+    }
+
+    int open_stdin() {
+        const size_t MAGIC_SIZE = 4u;
+        char buf[1 << 16];
+        while (_prefix.size() < MAGIC_SIZE) {
+            ssize_t ret = ::read(STDIN_FILENO, buf, sizeof(buf));
+            if (ret < 0 && errno == EINTR) {
+                continue;
+            }
+            if (ret < 0) {
+                std::cerr << "read input failed." << std::endl;
+                return -1;
+            }
+            if (ret == 0) {
+                break;
+            }
+            _prefix.append(buf, ret);
+        }
+        Compression compression = detect_compression(_prefix.data(), _prefix.size());
+        if (compression != COMPRESS_NONE) {
+            return open_compressed(compression, RawInput(STDIN_FILENO, std::move(_prefix)));
+        }
+        // plain input: the sniffed prefix, then the rest of stdin.
+        cookie_io_functions_t io = {};
+        io.read = &InputStream::read_plain;
+        _stream = fopencookie(this, "r", io);
+        if (_stream == nullptr) {
+            std::cerr << "open input stream failed." << std::endl;
+            return -1;
+        }
+        setvbuf(_stream, nullptr, _IOFBF, 1u << 16);
+        return 0;
+    }
+
+    int open_compressed(Compression compression, RawInput input) {
+        if (!compression_supported(compression)) {
+            return -1;
+        }
+        _compressed.reset(new CompressedInput(compression, std::move(input)));
+        _stream = _compressed->open();
+        return _stream == nullptr ? -1 : 0;
+    }
+
+    FILE* stream() const {
+        return _stream;
+    }
+
+    // -1 if a compressed input turned out to be corrupt.
+    int close() {
+        int ret = 0;
+        if (_compressed) {
+            ret = _compressed->close();
+            _compressed.reset();
+        } else if (_stream != nullptr) {
+            fclose(_stream);
+        }
+        _stream = nullptr;
+        return ret;
+    }
+
+private:
+    static ssize_t read_plain(void* cookie, char* buf, size_t size) {
+        InputStream* self = static_cast<InputStream*>(cookie);
+        if (self->_offset < self->_prefix.size()) {
+            size_t n = std::min(size, self->_prefix.size() - self->_offset);
+            memcpy(buf, self->_prefix.data() + self->_offset, n);
+            self->_offset += n;
+            return n;
+        }
+        ssize_t ret = 0;
+        while ((ret = ::read(STDIN_FILENO, buf, size)) < 0 && errno == EINTR) {
+        }
+        return ret;
+    }
+
+    std::string _prefix;
+    size_t _offset = 0u;
+    std::unique_ptr<CompressedInput> _compressed;
+    FILE* _stream = nullptr;
+};
+
+#endif // DATA_CLEANER_INPUT_STREAM_H
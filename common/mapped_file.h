@@ -0,0 +1,62 @@
+#ifndef DATA_CLEANER_MAPPED_FILE_H
+#define DATA_CLEANER_MAPPED_FILE_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <iostream>
+
+// Read only mapping of a whole input file. Lines are tokenized straight from
+// the mapped pages, nothing is copied and the source is never written.
+class MappedFile {
+public:
+    ~MappedFile() {
+        if (_data != nullptr) {
+            munmap(_data, _size);
+        }
+    }
+
+    int open(const char* path) {
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) {
+            std::cerr << "Open input file [" << path << "] failed." << std::endl;
+            return -1;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            std::cerr << "stat input file [" << path << "] failed." << std::endl;
+            close(fd);
+            return -1;
+        }
+        _size = st.st_size;
+        if (_size == 0u) {
+            close(fd);
+            return 0;
+        }
+        void* data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED) {
+            std::cerr << "mmap input file [" << path << "] failed." << std::endl;
+            _size = 0u;
+            return -1;
+        }
+        madvise(data, _size, MADV_SEQUENTIAL);
+        _data = data;
+        return 0;
+    }
+
+    const char* data() const {
+        return static_cast<const char*>(_data);
+    }
+
+    size_t size() const {
+        return _size;
+    }
+
+private:
+    void* _data = nullptr;
+    size_t _size = 0u;
+};
+
+#endif // DATA_CLEANER_MAPPED_FILE_H
@@ -0,0 +1,271 @@
+#ifndef DATA_CLEANER_OUTPUT_BUFFER_H
+#define DATA_CLEANER_OUTPUT_BUFFER_H
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <cmath>
+#include <cstring>
+#include <string>
+
+#include "str_view.h"
+
+static const char DIGIT_PAIRS[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+// Writes the decimal digits of `value` ending at `end` and returns the first
+// written byte.
+inline char* format_uint_backward(uint64_t value, char* end) {
+    while (value >= 100u) {
+        unsigned pair = static_cast<unsigned>(value % 100u) * 2u;
+        value /= 100u;
+        *--end = DIGIT_PAIRS[pair + 1];
+        *--end = DIGIT_PAIRS[pair];
+    }
+    if (value >= 10u) {
+        unsigned pair = static_cast<unsigned>(value) * 2u;
+        *--end = DIGIT_PAIRS[pair + 1];
+        *--end = DIGIT_PAIRS[pair];
+    } else {
+        *--end = static_cast<char>('0' + value);
+    }
+    return end;
+}
+
+// Formats `value` with the fewest digits that strtod reads back as exactly
+// `value`; `buf` needs 32 bytes. Values with up to 17 fractional digits and
+// a 53 bit mantissa are printed in fixed notation without touching stdio,
+// everything else falls back to the shortest of %.15g/%.16g/%.17g.
+inline size_t format_double(double value, char* buf) {
+    static const double POW10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+        1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17};
+    static const uint64_t UPOW10[] = {
+        1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull,
+        100000000ull, 1000000000ull, 10000000000ull, 100000000000ull, 1000000000000ull,
+        10000000000000ull, 100000000000000ull, 1000000000000000ull, 10000000000000000ull,
+        100000000000000000ull};
+    const double MAX_EXACT = 9007199254740992.0;
+    if (std::isfinite(value) && std::fabs(value) < MAX_EXACT) {
+        bool negative = std::signbit(value);
+        double magnitude = std::fabs(value);
+        for (size_t k = 0u; k < sizeof(POW10) / sizeof(POW10[0]); ++k) {
+            double scaled = magnitude * POW10[k];
+            if (scaled >= MAX_EXACT) {
+                break;
+            }
+            double rounded = std::floor(scaled + 0.5);
+            if (rounded / POW10[k] != magnitude) {
+                continue;
+            }
+            // rounded * 10^-k is exact in the decimal and rounds to value.
+            uint64_t digits = static_cast<uint64_t>(rounded);
+            char tmp[40];
+            char* end = tmp + sizeof(tmp);
+            char* begin = end;
+            if (k > 0u) {
+                begin = format_uint_backward(digits % UPOW10[k], end);
+                while (end - begin < static_cast<ptrdiff_t>(k)) {
+                    *--begin = '0';
+                }
+                *--begin = '.';
+            }
+            begin = format_uint_backward(digits / UPOW10[k], begin);
+            if (negative) {
+                *--begin = '-';
+            }
+            size_t len = end - begin;
+            memcpy(buf, begin, len);
+            return len;
+        }
+    }
+    int len = 0;
+    for (int precision = 15; precision <= 17; ++precision) {
+        len = snprintf(buf, 32, "%.*g", precision, value);
+        if (!std::isfinite(value)) {
+            break;
+        }
+        double parsed = 0.0;
+        parse_float(buf, len, parsed);
+        if (parsed == value) {
+            break;
+        }
+    }
+    return len;
+}
+
+// Append only byte buffer for instance and label text. Storage is page
+// aligned and grows geometrically; flush_to() hands it to write(2) directly,
+// without stdio or iostream locale handling.
+class OutputBuffer {
+public:
+    static const size_t ALIGNMENT = 4096u;
+
+    explicit OutputBuffer(size_t capacity = 1u << 16) {
+        reserve(capacity);
+    }
+
+    ~OutputBuffer() {
+        free(_data);
+    }
+
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+    OutputBuffer(OutputBuffer&& other)
+        : _data(other._data), _size(other._size), _capacity(other._capacity) {
+        other._data = nullptr;
+        other._size = 0u;
+        other._capacity = 0u;
+    }
+
+    OutputBuffer& operator=(OutputBuffer&& other) {
+        if (this != &other) {
+            free(_data);
+            _data = other._data;
+            _size = other._size;
+            _capacity = other._capacity;
+            other._data = nullptr;
+            other._size = 0u;
+            other._capacity = 0u;
+        }
+        return *this;
+    }
+
+    const char* data() const {
+        return _data;
+    }
+
+    size_t size() const {
+        return _size;
+    }
+
+    void clear() {
+        _size = 0u;
+    }
+
+    void append(const char* data, size_t size) {
+        if (_size + size > _capacity) {
+            reserve(_size + size);
+        }
+        memcpy(_data + _size, data, size);
+        _size += size;
+    }
+
+    OutputBuffer& operator<<(char c) {
+        if (_size == _capacity) {
+            reserve(_size + 1u);
+        }
+        _data[_size++] = c;
+        return *this;
+    }
+
+    OutputBuffer& operator<<(const char* str) {
+        append(str, strlen(str));
+        return *this;
+    }
+
+    OutputBuffer& operator<<(const std::string& str) {
+        append(str.data(), str.size());
+        return *this;
+    }
+
+    OutputBuffer& operator<<(StrView str) {
+        append(str.data, str.size);
+        return *this;
+    }
+
+    OutputBuffer& operator<<(unsigned long long value) {
+        char tmp[24];
+        char* end = tmp + sizeof(tmp);
+        char* begin = format_uint_backward(value, end);
+        append(begin, end - begin);
+        return *this;
+    }
+
+    OutputBuffer& operator<<(long long value) {
+        char tmp[24];
+        char* end = tmp + sizeof(tmp);
+        // negate in unsigned arithmetic so LLONG_MIN does not overflow.
+        uint64_t magnitude = value < 0 ? 0u - static_cast<uint64_t>(value) : value;
+        char* begin = format_uint_backward(magnitude, end);
+        if (value < 0) {
+            *--begin = '-';
+        }
+        append(begin, end - begin);
+        return *this;
+    }
+
+    OutputBuffer& operator<<(unsigned long value) {
+        return *this << static_cast<unsigned long long>(value);
+    }
+
+    OutputBuffer& operator<<(unsigned value) {
+        return *this << static_cast<unsigned long long>(value);
+    }
+
+    OutputBuffer& operator<<(long value) {
+        return *this << static_cast<long long>(value);
+    }
+
+    OutputBuffer& operator<<(int value) {
+        return *this << static_cast<long long>(value);
+    }
+
+    OutputBuffer& operator<<(double value) {
+        if (_capacity - _size < 32u) {
+            reserve(_size + 32u);
+        }
+        _size += format_double(value, _data + _size);
+        return *this;
+    }
+
+    // writes everything to `fd` and empties the buffer.
+    int flush_to(int fd) {
+        size_t written = 0u;
+        while (written < _size) {
+            ssize_t ret = ::write(fd, _data + written, _size - written);
+            if (ret < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                _size = 0u;
+                return -1;
+            }
+            written += ret;
+        }
+        _size = 0u;
+        return 0;
+    }
+
+private:
+    void reserve(size_t capacity) {
+        if (capacity <= _capacity) {
+            return;
+        }
+        size_t new_capacity = _capacity == 0u ? ALIGNMENT : _capacity;
+        while (new_capacity < capacity) {
+            new_capacity *= 2u;
+        }
+        void* data = nullptr;
+        if (posix_memalign(&data, ALIGNMENT, new_capacity) != 0) {
+            abort();
+        }
+        if (_size > 0u) {
+            memcpy(data, _data, _size);
+        }
+        free(_data);
+        _data = static_cast<char*>(data);
+        _capacity = new_capacity;
+    }
+
+    char* _data = nullptr;
+    size_t _size = 0u;
+    size_t _capacity = 0u;
+};
+
+#endif // DATA_CLEANER_OUTPUT_BUFFER_H
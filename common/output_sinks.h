@@ -0,0 +1,240 @@
+#ifndef DATA_CLEANER_OUTPUT_SINKS_H
+#define DATA_CLEANER_OUTPUT_SINKS_H
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <memory>
+
+#include "compression.h"
+#include "output_buffer.h"
+
+// How far each sink that is a regular file of its own has been written, -1
+// for the others (stdout, stderr, /dev/null, the labels file diagnostics
+// share). See OutputSinks::offsets and rewind.
+struct SinkOffsets {
+    int64_t instances = -1;
+    int64_t labels = -1;
+    int64_t diagnostics = -1;
+};
+
+// The files instances, labels and diagnostics are written to. Unset sinks
+// keep the original split: instances on stdout, labels and diagnostics on
+// stderr. Instances, and labels written to their own file, can be
+// compressed, each on its own thread.
+class OutputSinks {
+public:
+    OutputSinks() = default;
+    OutputSinks(const OutputSinks&) = delete;
+    OutputSinks& operator=(const OutputSinks&) = delete;
+
+    ~OutputSinks() {
+        close();
+        if (_instances > STDERR_FILENO) {
+            ::close(_instances);
+        }
+        if (_labels > STDERR_FILENO) {
+            ::close(_labels);
+        }
+        if (_diagnostics > STDERR_FILENO && _diagnostics != _labels) {
+            ::close(_diagnostics);
+        }
+    }
+
+    // any path may be nullptr for the default. With `keep` existing files
+    // are not truncated, rewind() cuts them back to where a checkpoint left
+    // them.
+    int open(const char* instances, const char* labels, const char* diagnostics,
+            Compression compression = COMPRESS_NONE, int level = 0, bool keep = false) {
+        if (open_sink(instances, _instances, keep) != 0 ||
+                open_sink(labels, _labels, keep) != 0) {
+            return -1;
+        }
+        if (same_path(labels, diagnostics)) {
+            _diagnostics = _labels;
+        } else if (open_sink(diagnostics, _diagnostics, keep) != 0) {
+            return -1;
+        }
+        if (compression != COMPRESS_NONE) {
+            if (!compression_supported(compression)) {
+                return -1;
+            }
+            _instances_codec.reset(new CompressedOutput(_instances, compression, level));
+            if (labels != nullptr) {
+                _labels_codec.reset(new CompressedOutput(_labels, compression, level));
+            }
+        }
+        return 0;
+    }
+
+    // each write empties `buffer`; the first failure is kept, see failed().
+    int write_instances(OutputBuffer& buffer) {
+        return checked(_instances_codec ? _instances_codec->write(buffer)
+                                        : buffer.flush_to(_instances));
+    }
+
+    int write_labels(OutputBuffer& buffer) {
+        return checked(_labels_codec ? _labels_codec->write(buffer) : buffer.flush_to(_labels));
+    }
+
+    int write_diagnostics(OutputBuffer& buffer) {
+        return merged() ? write_labels(buffer) : checked(buffer.flush_to(_diagnostics));
+    }
+
+    // whether any write has failed, e.g. on a full disk.
+    bool failed() const {
+        return _failed.load(std::memory_order_relaxed);
+    }
+
+    // finishes the compressed streams; -1 if one of them or any write
+    // failed.
+    int close() {
+        int ret = failed() ? -1 : 0;
+        if (_instances_codec && _instances_codec->close() != 0) {
+            ret = -1;
+        }
+        if (_labels_codec && _labels_codec->close() != 0) {
+            ret = -1;
+        }
+        return ret;
+    }
+
+    // labels and diagnostics go to one file; they then share one buffer so
+    // they stay in line order.
+    bool merged() const {
+        return _labels == _diagnostics;
+    }
+
+    // Only meaningful for uncompressed sinks, whose buffers go to the file
+    // as soon as they are written.
+    SinkOffsets offsets() const {
+        SinkOffsets offsets;
+        offsets.instances = file_offset(_instances);
+        offsets.labels = file_offset(_labels);
+        offsets.diagnostics = merged() ? -1 : file_offset(_diagnostics);
+        return offsets;
+    }
+
+    // puts what was written to the file sinks on disk.
+    int sync() {
+        int fds[] = {_instances, _labels, _diagnostics};
+        for (int fd : fds) {
+            if (file_offset(fd) >= 0 && fdatasync(fd) != 0) {
+                std::cerr << "sync output failed." << std::endl;
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    // Truncates the file sinks to `offsets` and continues writing there; the
+    // sinks have to be the files the offsets were taken from.
+    int rewind(const SinkOffsets& offsets) {
+        SinkOffsets current = this->offsets();
+        if ((current.instances < 0) != (offsets.instances < 0) ||
+                (current.labels < 0) != (offsets.labels < 0) ||
+                (current.diagnostics < 0) != (offsets.diagnostics < 0)) {
+            std::cerr << "the output files differ from the checkpoint's." << std::endl;
+            return -1;
+        }
+        return rewind_sink(_instances, offsets.instances) == 0 &&
+               rewind_sink(_labels, offsets.labels) == 0 &&
+               rewind_sink(_diagnostics, offsets.diagnostics) == 0 ? 0 : -1;
+    }
+
+private:
+    int checked(int ret) {
+        if (ret != 0 && !_failed.exchange(true)) {
+            std::cerr << "write output failed." << std::endl;
+        }
+        return ret;
+    }
+
+    static bool same_path(const char* a, const char* b) {
+        return a == b || (a != nullptr && b != nullptr && strcmp(a, b) == 0);
+    }
+
+    // -1 unless the sink is a regular file; /dev/null, pipes and ttys can
+    // be neither synced nor truncated.
+    static int64_t file_offset(int fd) {
+        struct stat st;
+        if (fd <= STDERR_FILENO || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+            return -1;
+        }
+        return static_cast<int64_t>(lseek(fd, 0, SEEK_CUR));
+    }
+
+    static int rewind_sink(int fd, int64_t offset) {
+        if (offset < 0) {
+            return 0;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < offset) {
+            std::cerr << "an output file is shorter than the checkpoint says." << std::endl;
+            return -1;
+        }
+        if (ftruncate(fd, offset) != 0 || lseek(fd, offset, SEEK_SET) != offset) {
+            std::cerr << "truncate output file failed." << std::endl;
+            return -1;
+        }
+        return 0;
+    }
+
+    static int open_sink(const char* path, int& fd, bool keep) {
+        if (path == nullptr) {
+            return 0;
+        }
+        fd = ::open(path, O_WRONLY | O_CREAT | (keep ? 0 : O_TRUNC), 0644);
+        if (fd < 0) {
+            std::cerr << "Open output file [" << path << "] failed." << std::endl;
+            return -1;
+        }
+        return 0;
+    }
+
+    int _instances = STDOUT_FILENO;
+    int _labels = STDERR_FILENO;
+    int _diagnostics = STDERR_FILENO;
+    std::unique_ptr<CompressedOutput> _instances_codec;
+    std::unique_ptr<CompressedOutput> _labels_codec;
+    std::atomic<bool> _failed{false};
+};
+
+// What one line, or one chunk of lines, writes to each sink.
+struct SinkBuffers {
+    explicit SinkBuffers(bool merged, size_t capacity = 1u << 16)
+        : instances(capacity), labels(capacity), diagnostics(merged ? 0u : capacity),
+          merged(merged) {}
+
+    OutputBuffer& diag() {
+        return merged ? labels : diagnostics;
+    }
+
+    // writes out every buffer holding at least `min_size` bytes; -1 if a
+    // write failed.
+    int flush_to(OutputSinks& sinks, size_t min_size = 0u) {
+        int ret = 0;
+        if (instances.size() >= min_size && sinks.write_instances(instances) != 0) {
+            ret = -1;
+        }
+        if (labels.size() >= min_size && sinks.write_labels(labels) != 0) {
+            ret = -1;
+        }
+        if (!merged && diagnostics.size() >= min_size &&
+                sinks.write_diagnostics(diagnostics) != 0) {
+            ret = -1;
+        }
+        return ret;
+    }
+
+    OutputBuffer instances;
+    OutputBuffer labels;
+    OutputBuffer diagnostics;
+    bool merged;
+};
+
+#endif // DATA_CLEANER_OUTPUT_SINKS_H
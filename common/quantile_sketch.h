@@ -0,0 +1,155 @@
+#ifndef DATA_CLEANER_QUANTILE_SKETCH_H
+#define DATA_CLEANER_QUANTILE_SKETCH_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+// KLL quantile sketch (Karnin, Lang, Liberty): a stack of compactors where an
+// item on level h stands for 2^h values. A level that reaches its capacity is
+// sorted and every other item, starting at a random offset, moves up a level.
+// Capacities shrink by 2/3 per level below the top, so a sketch holds about
+// 3k items whatever the number of values, with a rank error of roughly 1.7/k.
+// Sketches of the same column built on different threads merge into one.
+// Values have to be finite; a NaN breaks the ordering the sort relies on.
+class QuantileSketch {
+public:
+    explicit QuantileSketch(size_t k = 200u, uint64_t seed = 0x9e3779b97f4a7c15ull)
+        : _k(k), _rng(seed | 1u), _levels(1), _add_capacity(capacity(0u)) {}
+
+    void add(double value) {
+        _levels[0].push_back(value);
+        ++_count;
+        if (_levels[0].size() >= _add_capacity) {
+            compress();
+        }
+    }
+
+    void merge(const QuantileSketch& other) {
+        if (other._levels.size() > _levels.size()) {
+            _levels.resize(other._levels.size());
+        }
+        for (size_t h = 0u; h < other._levels.size(); ++h) {
+            _levels[h].insert(_levels[h].end(), other._levels[h].begin(), other._levels[h].end());
+        }
+        _count += other._count;
+        compress();
+    }
+
+    uint64_t count() const {
+        return _count;
+    }
+
+    // The value at rank q (0 <= q <= 1) among those added, NaN if none were.
+    double quantile(double q) const {
+        std::vector<std::pair<double, uint64_t>> items = weighted_items();
+        uint64_t total = 0u;
+        for (const auto& item : items) {
+            total += item.second;
+        }
+        uint64_t rank = 0u;
+        for (const auto& item : items) {
+            rank += item.second;
+            if (rank >= q * total) {
+                return item.first;
+            }
+        }
+        return items.empty() ? std::nan("") : items.back().first;
+    }
+
+    // The n - 1 boundaries that cut the values into n equally full buckets,
+    // ascending and without duplicates, so heavy values get one bucket.
+    std::vector<double> boundaries(size_t n) const {
+        std::vector<std::pair<double, uint64_t>> items = weighted_items();
+        uint64_t total = 0u;
+        for (const auto& item : items) {
+            total += item.second;
+        }
+        std::vector<double> bounds;
+        uint64_t rank = 0u;
+        size_t next = 1u;
+        for (const auto& item : items) {
+            rank += item.second;
+            while (next < n && rank * n >= total * next) {
+                if (bounds.empty() || bounds.back() < item.first) {
+                    bounds.push_back(item.first);
+                }
+                ++next;
+            }
+        }
+        return bounds;
+    }
+
+private:
+    // every retained item with its weight, by value.
+    std::vector<std::pair<double, uint64_t>> weighted_items() const {
+        std::vector<std::pair<double, uint64_t>> items;
+        for (size_t h = 0u; h < _levels.size(); ++h) {
+            for (double value : _levels[h]) {
+                items.push_back(std::make_pair(value, uint64_t(1u) << h));
+            }
+        }
+        std::sort(items.begin(), items.end());
+        return items;
+    }
+
+    size_t capacity(size_t level) const {
+        size_t depth = _levels.size() - 1u - level;
+        return std::max<size_t>(8u, static_cast<size_t>(_k * std::pow(2.0 / 3.0, depth)));
+    }
+
+    bool coin() {
+        _rng ^= _rng << 13;
+        _rng ^= _rng >> 7;
+        _rng ^= _rng << 17;
+        return (_rng & 1u) != 0u;
+    }
+
+    void compress() {
+        for (size_t h = 0u; h < _levels.size(); ++h) {
+            if (_levels[h].size() < capacity(h)) {
+                continue;
+            }
+            if (h + 1u == _levels.size()) {
+                _levels.emplace_back();
+            }
+            std::vector<double>& level = _levels[h];
+            std::sort(level.begin(), level.end());
+            // an odd item out stays behind.
+            size_t paired = level.size() / 2u * 2u;
+            for (size_t i = coin() ? 1u : 0u; i < paired; i += 2u) {
+                _levels[h + 1u].push_back(level[i]);
+            }
+            level.erase(level.begin(), level.begin() + paired);
+        }
+        _add_capacity = capacity(0u);
+    }
+
+    size_t _k;
+    uint64_t _rng;
+    uint64_t _count = 0u;
+    std::vector<std::vector<double>> _levels;
+    // capacity(0), which only changes when a level is added.
+    size_t _add_capacity;
+};
+
+// The number of boundaries <= value, i.e. its bucket. The halving search adds
+// the result of each comparison instead of branching on it, so there is
+// nothing to mispredict and every value costs the same log2(n) steps.
+inline size_t bucket_index(const std::vector<double>& bounds, double value) {
+    if (bounds.empty()) {
+        return 0u;
+    }
+    const double* base = bounds.data();
+    size_t n = bounds.size();
+    while (n > 1u) {
+        size_t half = n / 2u;
+        base += (base[half - 1u] <= value) * half;
+        n -= half;
+    }
+    return static_cast<size_t>(base - bounds.data()) + (*base <= value ? 1u : 0u);
+}
+
+#endif // DATA_CLEANER_QUANTILE_SKETCH_H
@@ -0,0 +1,189 @@
+#ifndef DATA_CLEANER_ROW_DEDUP_H
+#define DATA_CLEANER_ROW_DEDUP_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "MurmurHash3.h"
+#include "str_view.h"
+
+const uint64_t DEDUP_SEED = 0x5bd1e995u;
+
+// Bloom filter of 512 bit blocks: a key sets all of its bits in the one
+// cache line its hash picks, so a lookup costs one cache miss however many
+// bits it tests. Words are set with atomic ors, so the workers of a run share
+// one filter. It answers "maybe seen" for keys that were added and, at the
+// rate it was sized for, for some that were not; it never forgets a key.
+class BlockedBloomFilter {
+public:
+    static const size_t BLOCK_WORDS = 8u;
+    static const unsigned BLOCK_BITS = 512u;
+    static const unsigned MAX_HASHES = 16u;
+
+    BlockedBloomFilter() = default;
+    BlockedBloomFilter(const BlockedBloomFilter&) = delete;
+    BlockedBloomFilter& operator=(const BlockedBloomFilter&) = delete;
+
+    ~BlockedBloomFilter() {
+        free(_words);
+    }
+
+    // Sizes the filter for `capacity` keys at a false positive rate of at
+    // most `fp_rate` once it is full. Keys do not spread evenly over the
+    // blocks, so the classic -ln(p) / ln(2)^2 bits per key fall short; bits
+    // are added until the rate of a blocked filter, see false_positive_rate,
+    // is low enough. The memory comes from calloc, so pages are only touched
+    // when used.
+    int init(uint64_t capacity, double fp_rate) {
+        double bits_per_key = -std::log(fp_rate) / (M_LN2 * M_LN2);
+        while (true) {
+            _hashes = static_cast<unsigned>(std::lround(bits_per_key * M_LN2));
+            _hashes = std::min(std::max(_hashes, 1u), MAX_HASHES);
+            if (false_positive_rate(bits_per_key, _hashes) <= fp_rate) {
+                break;
+            }
+            bits_per_key += 0.25;
+        }
+        double keys = static_cast<double>(std::max<uint64_t>(capacity, 1u));
+        double bits = std::ceil(bits_per_key * keys);
+        _blocks = static_cast<uint64_t>(std::ceil(bits / BLOCK_BITS));
+        _words = static_cast<std::atomic<uint64_t>*>(
+            calloc(_blocks * BLOCK_WORDS, sizeof(std::atomic<uint64_t>)));
+        if (_words == nullptr) {
+            std::cerr << "allocate a dedup filter of " << bytes() << " bytes failed." << std::endl;
+            return -1;
+        }
+        return 0;
+    }
+
+    // The false positive rate of a full filter: the key count of a block is
+    // Poisson distributed, the rate is that of a plain Bloom filter of one
+    // block with as many keys, averaged over those counts.
+    static double false_positive_rate(double bits_per_key, unsigned hashes) {
+        double mean = BLOCK_BITS / bits_per_key;
+        double poisson = std::exp(-mean);
+        double rate = 0.0;
+        for (unsigned keys = 0u; keys < 8u * BLOCK_BITS; ++keys) {
+            double unset = std::pow(1.0 - 1.0 / BLOCK_BITS, static_cast<double>(hashes) * keys);
+            rate += poisson * std::pow(1.0 - unset, hashes);
+            poisson *= mean / (keys + 1u);
+        }
+        return rate;
+    }
+
+    // Adds the key; true if all of its bits were set already, that is if it
+    // was (probably) added before. Only words that miss bits take an atomic
+    // or, so a duplicate costs plain loads; two workers adding the same key
+    // at once may both see it as new.
+    bool test_and_add(uint64_t hash) {
+        uint64_t block = static_cast<uint64_t>(
+            (static_cast<unsigned __int128>(hash) * _blocks) >> 64);
+        // every bit in the block takes 9 bits of a splitmix64 stream seeded
+        // with the hash; double hashing would leave only 2^17 bit patterns
+        // per block, and keys of one block would share them.
+        uint64_t masks[BLOCK_WORDS] = {};
+        uint64_t state = hash;
+        uint64_t bits = 0u;
+        for (unsigned i = 0u; i < _hashes; ++i, bits >>= 9) {
+            if (i % 7u == 0u) {
+                bits = splitmix64(state);
+            }
+            unsigned bit = static_cast<unsigned>(bits % BLOCK_BITS);
+            masks[bit / 64u] |= 1ull << (bit % 64u);
+        }
+        std::atomic<uint64_t>* words = _words + block * BLOCK_WORDS;
+        bool seen = true;
+        for (size_t w = 0u; w < BLOCK_WORDS; ++w) {
+            if ((words[w].load(std::memory_order_relaxed) & masks[w]) != masks[w]) {
+                uint64_t old = words[w].fetch_or(masks[w], std::memory_order_relaxed);
+                seen = seen && (old & masks[w]) == masks[w];
+            }
+        }
+        return seen;
+    }
+
+    uint64_t bytes() const {
+        return _blocks * BLOCK_WORDS * sizeof(uint64_t);
+    }
+
+    unsigned hashes() const {
+        return _hashes;
+    }
+
+private:
+    std::atomic<uint64_t>* _words = nullptr;
+    uint64_t _blocks = 0u;
+    unsigned _hashes = 1u;
+};
+
+// --dedup: drops every row whose key, the whole line or the values of some
+// columns, the filter has (probably) seen before. Workers share it, so with
+// --threads which of two duplicates is kept depends on which is cleaned
+// first; a false positive drops a row that was no duplicate.
+class RowDeduplicator {
+public:
+    // `key` is "row" or a comma separated list of schema column numbers.
+    int init(const char* key, size_t columns, uint64_t capacity, double fp_rate) {
+        if (strcmp(key, "row") != 0) {
+            for (const auto& token : split(StrView{key, strlen(key)}, ',')) {
+                std::string number = to_string(token);
+                char* end = nullptr;
+                unsigned long long column = strtoull(number.c_str(), &end, 10);
+                if (number.empty() || *end != '\0' || column >= columns) {
+                    std::cerr << "invalid --dedup column [" << number << "]" << std::endl;
+                    return -1;
+                }
+                _columns.push_back(column);
+            }
+        }
+        return _filter.init(capacity, fp_rate);
+    }
+
+    // Whether the row was seen before; it is added to the filter either way.
+    bool is_duplicate(StrView line, const std::vector<StrView>& tokens) {
+        uint64_t hash = DEDUP_SEED;
+        if (_columns.empty()) {
+            hash = MurmurHash64A(line.data, line.size, DEDUP_SEED);
+        }
+        // the hashes of the values are folded in order, so ("ab", "c") and
+        // ("a", "bc") differ. Seeding each with the one before would keep
+        // only 32 bits of it, MurmurHash64A takes a 32 bit seed.
+        for (size_t column : _columns) {
+            StrView value = column < tokens.size() ? tokens[column] : StrView{"", 0u};
+            hash = (hash ^ MurmurHash64A(value.data, value.size, DEDUP_SEED)) *
+                   0x9e3779b97f4a7c15ull;
+        }
+        if (!_filter.test_and_add(hash)) {
+            return false;
+        }
+        _dropped.fetch_add(1u, std::memory_order_relaxed);
+        return true;
+    }
+
+    // the key columns, empty for whole lines.
+    const std::vector<size_t>& columns() const {
+        return _columns;
+    }
+
+    uint64_t dropped() const {
+        return _dropped.load(std::memory_order_relaxed);
+    }
+
+    const BlockedBloomFilter& filter() const {
+        return _filter;
+    }
+
+private:
+    std::vector<size_t> _columns;
+    BlockedBloomFilter _filter;
+    std::atomic<uint64_t> _dropped{0u};
+};
+
+#endif // DATA_CLEANER_ROW_DEDUP_H
@@ -0,0 +1,392 @@
+#ifndef DATA_CLEANER_ROW_FORMAT_H
+#define DATA_CLEANER_ROW_FORMAT_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "output_buffer.h"
+
+// Binary sparse row format, the --format binary alternative to the text
+// instance output. A stream is one RowFileHeader, `slot_count` RowSlot
+// descriptors and then rows:
+//   varint   size of the rest of the row in bytes
+//   bitmap   (slot_count + 7) / 8 bytes, bit set = slot has a value
+//   varint   byte length of every slot payload, in slot order
+//   payload  the slot payloads back to back
+// Slot payloads by type:
+//   ROW_SLOT_DOUBLE  8 byte little endian float64, a list of them for
+//                    ROW_ROLE_WEIGHT
+//   ROW_SLOT_INT     zigzag varint
+//   ROW_SLOT_SIGNS   a list of signs, either 8 byte little endian each or,
+//                    with ROW_SIGNS_VARINT_DELTA (dense vocabulary ids),
+//                    zigzag varints of the difference to the previous sign
+// Null slots have no payload. All integers are little endian, so rows are
+// self delimiting and can be concatenated in any order.
+enum RowSlotType : uint8_t {
+    ROW_SLOT_DOUBLE = 0,
+    ROW_SLOT_INT = 1,
+    ROW_SLOT_SIGNS = 2
+};
+
+// what part of its schema column a slot holds.
+enum RowSlotRole : uint8_t {
+    ROW_ROLE_VALUE = 0,
+    ROW_ROLE_MAX = 1,   // Multi-Valued CatNumerical key with the largest value
+    ROW_ROLE_MIN = 2,   // ... and with the smallest
+    ROW_ROLE_WEIGHT = 3 // ... the values of the keys, in key order
+};
+
+enum RowFileFlags : uint32_t {
+    ROW_SIGNS_VARINT_DELTA = 1u
+};
+
+struct RowFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t slot_count;
+    uint32_t flags;
+    uint32_t reserved;
+};
+
+struct RowSlot {
+    uint32_t column;
+    uint8_t type;
+    uint8_t role;
+    uint16_t reserved;
+};
+
+static const char ROW_MAGIC[8] = {'D', 'C', 'R', 'O', 'W', 'S', '1', '\0'};
+static const uint32_t ROW_VERSION = 1u;
+
+inline void put_fixed32(std::string& buf, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        buf.push_back(static_cast<char>(value >> (8 * i)));
+    }
+}
+
+inline void put_fixed64(std::string& buf, uint64_t value) {
+    char bytes[8];
+    for (int i = 0; i < 8; ++i) {
+        bytes[i] = static_cast<char>(value >> (8 * i));
+    }
+    buf.append(bytes, 8u);
+}
+
+inline void put_varint(std::string& buf, uint64_t value) {
+    char bytes[10];
+    size_t n = 0u;
+    while (value >= 0x80u) {
+        bytes[n++] = static_cast<char>(value | 0x80u);
+        value >>= 7;
+    }
+    bytes[n++] = static_cast<char>(value);
+    buf.append(bytes, n);
+}
+
+inline uint64_t zigzag_encode(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+inline int64_t zigzag_decode(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1u);
+}
+
+inline uint64_t get_fixed(const char* p, size_t n) {
+    uint64_t value = 0u;
+    for (size_t i = 0u; i < n; ++i) {
+        value |= static_cast<uint64_t>(static_cast<unsigned char>(p[i])) << (8u * i);
+    }
+    return value;
+}
+
+// Reads a varint at `p`, not past `end`; returns nullptr if it is cut off.
+inline const char* get_varint(const char* p, const char* end, uint64_t& value) {
+    value = 0u;
+    for (unsigned shift = 0u; p < end && shift < 64u; shift += 7u) {
+        unsigned char byte = static_cast<unsigned char>(*p++);
+        value |= static_cast<uint64_t>(byte & 0x7fu) << shift;
+        if (byte < 0x80u) {
+            return p;
+        }
+    }
+    return nullptr;
+}
+
+// Serialized stream header for `slots`.
+inline std::string encode_row_header(const std::vector<RowSlot>& slots, uint32_t flags) {
+    std::string buf(ROW_MAGIC, sizeof(ROW_MAGIC));
+    put_fixed32(buf, ROW_VERSION);
+    put_fixed32(buf, slots.size());
+    put_fixed32(buf, flags);
+    put_fixed32(buf, 0u);
+    for (const auto& slot : slots) {
+        put_fixed32(buf, slot.column);
+        buf.push_back(static_cast<char>(slot.type));
+        buf.push_back(static_cast<char>(slot.role));
+        buf.append(2u, '\0');
+    }
+    return buf;
+}
+
+// Builds one row. Values have to be put in ascending slot order; slots that
+// get no value are null. Every value is kept as one 64 bit word (a sign, the
+// bits of a double or an int64) until the row is finished, either into the
+// binary row format or, for the library, as the words themselves. Every
+// pipeline worker owns one encoder.
+class RowEncoder {
+public:
+    RowEncoder(const std::vector<RowSlot>& slots, uint32_t flags)
+        : _ends(slots.size(), 0u), _bitmap((slots.size() + 7u) / 8u, '\0'),
+          _delta_signs((flags & ROW_SIGNS_VARINT_DELTA) != 0u) {
+        for (const auto& slot : slots) {
+            _types.push_back(slot.type);
+        }
+    }
+
+    void begin() {
+        _words.clear();
+        std::fill(_bitmap.begin(), _bitmap.end(), '\0');
+        _slot = 0u;
+    }
+
+    void put_double(size_t slot, double value) {
+        uint64_t bits = 0u;
+        memcpy(&bits, &value, sizeof(bits));
+        open(slot);
+        _words.push_back(bits);
+    }
+
+    void put_int(size_t slot, int64_t value) {
+        open(slot);
+        _words.push_back(static_cast<uint64_t>(value));
+    }
+
+    // appends one sign to the list in `slot`.
+    void put_sign(size_t slot, uint64_t sign) {
+        open(slot);
+        _words.push_back(sign);
+    }
+
+    // appends the finished row to `out` in the binary row format.
+    void finish(OutputBuffer& out) {
+        close(_ends.size());
+        _payload.clear();
+        _header.clear();
+        _header.append(_bitmap);
+        size_t begin = 0u;
+        for (size_t i = 0u; i < _ends.size(); ++i) {
+            size_t payload_begin = _payload.size();
+            uint64_t prev_sign = 0u;
+            for (size_t w = begin; w < _ends[i]; ++w) {
+                if (_types[i] == ROW_SLOT_INT) {
+                    put_varint(_payload, zigzag_encode(static_cast<int64_t>(_words[w])));
+                } else if (_types[i] == ROW_SLOT_SIGNS && _delta_signs) {
+                    put_varint(_payload, zigzag_encode(static_cast<int64_t>(_words[w] - prev_sign)));
+                    prev_sign = _words[w];
+                } else {
+                    put_fixed64(_payload, _words[w]);
+                }
+            }
+            put_varint(_header, _payload.size() - payload_begin);
+            begin = _ends[i];
+        }
+        _size.clear();
+        put_varint(_size, _header.size() + _payload.size());
+        out.append(_size.data(), _size.size());
+        out.append(_header.data(), _header.size());
+        out.append(_payload.data(), _payload.size());
+    }
+
+    // appends the words of the finished row to `words` and, for every slot,
+    // the end of its words to `ends`; a null slot has no words.
+    void finish(std::vector<uint64_t>& words, std::vector<size_t>& ends) {
+        close(_ends.size());
+        size_t base = words.size();
+        words.insert(words.end(), _words.begin(), _words.end());
+        for (auto end : _ends) {
+            ends.push_back(base + end);
+        }
+    }
+
+private:
+    // ends every slot before `slot` at the current number of words.
+    void close(size_t slot) {
+        for (; _slot < slot; ++_slot) {
+            _ends[_slot] = _words.size();
+        }
+    }
+
+    void open(size_t slot) {
+        close(slot);
+        _bitmap[slot / 8u] |= static_cast<char>(1u << (slot % 8u));
+    }
+
+    std::vector<uint8_t> _types;
+    std::vector<size_t> _ends;
+    std::string _bitmap;
+    std::vector<uint64_t> _words;
+    std::string _payload;
+    std::string _header;
+    std::string _size;
+    size_t _slot = 0u;
+    bool _delta_signs;
+};
+
+// One decoded row; the payload pointers point into the reader's input.
+class RowView {
+public:
+    size_t slot_count() const {
+        return _begins.size();
+    }
+
+    bool is_null(size_t slot) const {
+        return !((static_cast<unsigned char>(_bitmap[slot / 8u]) >> (slot % 8u)) & 1u);
+    }
+
+    double number(size_t slot) const {
+        uint64_t bits = get_fixed(_begins[slot], 8u);
+        double value = 0.0;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    // clears `values` and fills it with the doubles in `slot`, the list of a
+    // ROW_ROLE_WEIGHT slot; number() reads the first one only.
+    void numbers(size_t slot, std::vector<double>& values) const {
+        values.clear();
+        for (const char* p = _begins[slot]; p + 8 <= _ends[slot]; p += 8) {
+            uint64_t bits = get_fixed(p, 8u);
+            double value = 0.0;
+            memcpy(&value, &bits, sizeof(value));
+            values.push_back(value);
+        }
+    }
+
+    int64_t integer(size_t slot) const {
+        uint64_t value = 0u;
+        get_varint(_begins[slot], _ends[slot], value);
+        return zigzag_decode(value);
+    }
+
+    // clears `signs` and fills it with the list in `slot`.
+    void signs(size_t slot, std::vector<uint64_t>& signs) const {
+        signs.clear();
+        const char* p = _begins[slot];
+        const char* end = _ends[slot];
+        if (!_delta_signs) {
+            for (; p + 8 <= end; p += 8) {
+                signs.push_back(get_fixed(p, 8u));
+            }
+            return;
+        }
+        uint64_t sign = 0u, delta = 0u;
+        while (p < end && (p = get_varint(p, end, delta)) != nullptr) {
+            sign += static_cast<uint64_t>(zigzag_decode(delta));
+            signs.push_back(sign);
+        }
+    }
+
+private:
+    friend class RowReader;
+
+    const char* _bitmap = nullptr;
+    std::vector<const char*> _begins;
+    std::vector<const char*> _ends;
+    bool _delta_signs = false;
+};
+
+// Reads a binary row stream held in memory, e.g. a MappedFile.
+class RowReader {
+public:
+    // parses the stream header; -1 if [data, data+size) is not a row stream.
+    int open(const char* data, size_t size) {
+        const size_t HEADER_SIZE = 24u, SLOT_SIZE = 8u;
+        if (size < HEADER_SIZE || memcmp(data, ROW_MAGIC, sizeof(ROW_MAGIC)) != 0 ||
+                get_fixed(data + 8, 4u) != ROW_VERSION) {
+            return -1;
+        }
+        uint64_t slot_count = get_fixed(data + 12, 4u);
+        _flags = static_cast<uint32_t>(get_fixed(data + 16, 4u));
+        if ((size - HEADER_SIZE) / SLOT_SIZE < slot_count) {
+            return -1;
+        }
+        const char* p = data + HEADER_SIZE;
+        _slots.resize(slot_count);
+        for (auto& slot : _slots) {
+            slot.column = static_cast<uint32_t>(get_fixed(p, 4u));
+            slot.type = static_cast<uint8_t>(p[4]);
+            slot.role = static_cast<uint8_t>(p[5]);
+            slot.reserved = 0u;
+            p += SLOT_SIZE;
+        }
+        _pos = p;
+        _end = data + size;
+        return 0;
+    }
+
+    const std::vector<RowSlot>& slots() const {
+        return _slots;
+    }
+
+    uint32_t flags() const {
+        return _flags;
+    }
+
+    // 1 with the next row in `row`, 0 at the end, -1 on a corrupt row.
+    int next(RowView& row) {
+        if (_pos == _end) {
+            return 0;
+        }
+        uint64_t size = 0u;
+        const char* p = get_varint(_pos, _end, size);
+        if (p == nullptr || size > static_cast<uint64_t>(_end - p)) {
+            return -1;
+        }
+        const char* end = p + size;
+        size_t bitmap_size = (_slots.size() + 7u) / 8u;
+        if (static_cast<size_t>(end - p) < bitmap_size) {
+            return -1;
+        }
+        row._bitmap = p;
+        row._delta_signs = (_flags & ROW_SIGNS_VARINT_DELTA) != 0u;
+        row._begins.resize(_slots.size());
+        row._ends.resize(_slots.size());
+        p += bitmap_size;
+        _lengths.resize(_slots.size());
+        uint64_t payload_size = 0u;
+        for (size_t i = 0u; i < _slots.size(); ++i) {
+            if ((p = get_varint(p, end, _lengths[i])) == nullptr) {
+                return -1;
+            }
+            // doubles are 8 bytes, weights a list of them.
+            if (_slots[i].type == ROW_SLOT_DOUBLE && !row.is_null(i) &&
+                    (_slots[i].role == ROW_ROLE_WEIGHT ? _lengths[i] % 8u != 0u
+                                                       : _lengths[i] != 8u)) {
+                return -1;
+            }
+            payload_size += _lengths[i];
+        }
+        if (payload_size != static_cast<uint64_t>(end - p)) {
+            return -1;
+        }
+        for (size_t i = 0u; i < _slots.size(); ++i) {
+            row._begins[i] = p;
+            p += _lengths[i];
+            row._ends[i] = p;
+        }
+        _pos = end;
+        return 1;
+    }
+
+private:
+    std::vector<RowSlot> _slots;
+    std::vector<uint64_t> _lengths;
+    uint32_t _flags = 0u;
+    const char* _pos = nullptr;
+    const char* _end = nullptr;
+};
+
+#endif // DATA_CLEANER_ROW_FORMAT_H
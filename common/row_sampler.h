@@ -0,0 +1,224 @@
+#ifndef DATA_CLEANER_ROW_SAMPLER_H
+#define DATA_CLEANER_ROW_SAMPLER_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "MurmurHash3.h"
+#include "output_buffer.h"
+#include "str_view.h"
+
+// A uniform double in [0, 1) from the top 53 bits of `bits`.
+inline double unit_interval(uint64_t bits) {
+    return static_cast<double>(bits >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Row sampling of a cleaning run, decided on the tokens before any column
+// is transformed, so dropped rows cost only the split:
+//   --sample RATE          keeps every row with probability RATE
+//   --label-rates L:R,...  keeps rows labelled L with probability R instead,
+//                          e.g. 0:0.1 downsamples negatives 10:1
+//   --sample-key COLUMN    decides by a hash of that column's value instead
+//                          of at random: the same keys are kept on every
+//                          run and at any thread count
+//   --reservoir N          keeps a uniform sample of N of the rows that pass
+//                          the rates, written at the end of the run with
+//                          their --sample-weight scaled by that downsampling
+// Random decisions use a splitmix64 stream per worker seeded from
+// --sample-seed, so they repeat with --threads 1 only. Workers share one
+// sampler.
+class RowSampler {
+public:
+    static const size_t NONE = std::numeric_limits<size_t>::max();
+
+    int init(double rate, const char* label_rates, const char* key, size_t reservoir,
+            uint64_t seed, size_t columns, size_t label_column) {
+        _rate = rate;
+        _seed = seed;
+        _label_column = label_column;
+        if (label_rates != nullptr) {
+            if (label_column == std::numeric_limits<size_t>::max()) {
+                std::cerr << "--label-rates needs a Label column." << std::endl;
+                return -1;
+            }
+            for (const auto& pair : split(StrView{label_rates, strlen(label_rates)}, ',')) {
+                // labels may hold ':', the rate follows the last one.
+                const char* colon = static_cast<const char*>(memrchr(pair.data, ':', pair.size));
+                double value = 0.0;
+                if (colon == nullptr ||
+                        !parse_number(StrView{colon + 1,
+                                static_cast<size_t>(pair.data + pair.size - colon - 1)}, value) ||
+                        !(value > 0.0 && value <= 1.0)) {
+                    std::cerr << "invalid --label-rates entry [" << pair << "]" << std::endl;
+                    return -1;
+                }
+                _labels.emplace_back(pair.data, colon);
+                _label_rates.push_back(value);
+            }
+        }
+        if (key != nullptr) {
+            char* end = nullptr;
+            unsigned long long column = strtoull(key, &end, 10);
+            if (end == key || *end != '\0' || column >= columns) {
+                std::cerr << "invalid --sample-key column [" << key << "]" << std::endl;
+                return -1;
+            }
+            _key_column = column;
+        }
+        _reservoir_size = reservoir;
+        _reservoir.resize(reservoir);
+        return 0;
+    }
+
+    // the seed of a new worker's random stream.
+    uint64_t thread_state() {
+        uint64_t state = _seed + _threads.fetch_add(1u, std::memory_order_relaxed);
+        return splitmix64(state);
+    }
+
+    // Whether the row passes the rates; `rate` is the one it was kept at.
+    bool keep(const std::vector<StrView>& tokens, uint64_t& state, double& rate) {
+        _seen.fetch_add(1u, std::memory_order_relaxed);
+        rate = _rate;
+        if (!_labels.empty() && _label_column < tokens.size()) {
+            StrView label = tokens[_label_column];
+            for (size_t i = 0u; i < _labels.size(); ++i) {
+                if (label.size == _labels[i].size() &&
+                        memcmp(label.data, _labels[i].data(), label.size) == 0) {
+                    rate = _label_rates[i];
+                    break;
+                }
+            }
+        }
+        if (rate >= 1.0) {
+            return true;
+        }
+        uint64_t bits = 0u;
+        if (_key_column == NONE) {
+            bits = splitmix64(state);
+        } else if (_key_column < tokens.size()) {
+            StrView key = tokens[_key_column];
+            uint64_t hash = MurmurHash64A(key.data, key.size, static_cast<unsigned int>(_seed));
+            bits = splitmix64(hash);
+        } else {
+            // no key to decide by.
+            return false;
+        }
+        return unit_interval(bits) < rate;
+    }
+
+    // the --sample-key column, NONE without one.
+    size_t key_column() const {
+        return _key_column;
+    }
+
+    bool has_reservoir() const {
+        return _reservoir_size != 0u;
+    }
+
+    // Algorithm R: the reservoir slot the row replaces, NONE if it is
+    // skipped. The i-th row passing the rates takes a slot with probability
+    // N / i, so only those rows are cleaned at all.
+    size_t reservoir_slot(uint64_t& state) {
+        uint64_t i = _passed.fetch_add(1u, std::memory_order_relaxed);
+        if (i < _reservoir_size) {
+            return i;
+        }
+        uint64_t j = static_cast<uint64_t>(
+            (static_cast<unsigned __int128>(splitmix64(state)) * (i + 1u)) >> 64);
+        return j < _reservoir_size ? j : NONE;
+    }
+
+    // Keeps the cleaned row in `slot`, replacing the one there. With
+    // --sample-weight [weight_begin, weight_end) of `instance` is the weight
+    // it was written with, 1 / `rate`; otherwise the range is empty.
+    void hold(size_t slot, const OutputBuffer& instance, const OutputBuffer& label, double rate,
+            size_t weight_begin, size_t weight_end) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        HeldRow& row = _reservoir[slot];
+        row.instance.assign(instance.data(), instance.size());
+        row.label.assign(label.data(), label.size());
+        row.rate = rate;
+        row.weight_begin = weight_begin;
+        row.weight_end = weight_end;
+    }
+
+    // the reservoir rows in slot order. Their weights are rewritten with the
+    // rate the reservoir kept them at on top, N of the M rows that passed the
+    // rates: (1 / rate) * M / N, as a float64 in binary rows, else as text.
+    void write_reservoir(OutputBuffer& instances, OutputBuffer& labels, bool binary) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        uint64_t passed = _passed.load(std::memory_order_relaxed);
+        double scale = passed > _reservoir_size ?
+            static_cast<double>(passed) / static_cast<double>(_reservoir_size) : 1.0;
+        for (const auto& row : _reservoir) {
+            if (row.weight_begin == row.weight_end) {
+                instances << row.instance;
+            } else {
+                double weight = scale / row.rate;
+                instances.append(row.instance.data(), row.weight_begin);
+                if (binary) {
+                    uint64_t bits = 0u;
+                    memcpy(&bits, &weight, sizeof(bits));
+                    char bytes[8];
+                    for (int i = 0; i < 8; ++i) {
+                        bytes[i] = static_cast<char>(bits >> (8 * i));
+                    }
+                    instances.append(bytes, sizeof(bytes));
+                } else {
+                    instances << weight;
+                }
+                instances.append(row.instance.data() + row.weight_end,
+                        row.instance.size() - row.weight_end);
+            }
+            labels << row.label;
+        }
+    }
+
+    // rows offered to the sampler, and rows it finally kept.
+    uint64_t seen() const {
+        return _seen.load(std::memory_order_relaxed);
+    }
+
+    uint64_t kept() const {
+        uint64_t offered = _passed.load(std::memory_order_relaxed);
+        return has_reservoir() ? std::min<uint64_t>(offered, _reservoir_size) : offered;
+    }
+
+    // counts a row that passed the rates without a reservoir.
+    void count_kept() {
+        _passed.fetch_add(1u, std::memory_order_relaxed);
+    }
+
+private:
+    struct HeldRow {
+        std::string instance;
+        std::string label;
+        double rate = 1.0;
+        size_t weight_begin = 0u;
+        size_t weight_end = 0u;
+    };
+
+    double _rate = 1.0;
+    uint64_t _seed = 0u;
+    size_t _label_column = std::numeric_limits<size_t>::max();
+    std::vector<std::string> _labels;
+    std::vector<double> _label_rates;
+    size_t _key_column = NONE;
+    size_t _reservoir_size = 0u;
+    std::vector<HeldRow> _reservoir;
+    std::mutex _mutex;
+    std::atomic<uint64_t> _threads{0u};
+    std::atomic<uint64_t> _seen{0u};
+    std::atomic<uint64_t> _passed{0u};
+};
+
+#endif // DATA_CLEANER_ROW_SAMPLER_H
@@ -0,0 +1,246 @@
+#ifndef DATA_CLEANER_RUN_STATS_H
+#define DATA_CLEANER_RUN_STATS_H
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "diagnostics.h"
+#include "output_buffer.h"
+
+// Counters are written by their own worker only and read by the snapshot
+// thread, so a relaxed load and store is enough and avoids a locked add.
+inline void bump(std::atomic<uint64_t>& counter, uint64_t n = 1u) {
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+// Every TIME_SAMPLE-th cell of a column is timed, the time of the column is
+// extrapolated from those.
+const uint64_t TIME_SAMPLE = 16u;
+
+struct ColumnStats {
+    std::atomic<uint64_t> cells{0u};
+    std::atomic<uint64_t> nulls{0u};
+    // cells that reported at least one diagnostic.
+    std::atomic<uint64_t> failures{0u};
+    std::atomic<uint64_t> timed_cells{0u};
+    std::atomic<uint64_t> timed_ns{0u};
+};
+
+// The counters of one worker.
+struct ThreadStats {
+    explicit ThreadStats(size_t columns) : columns(columns) {}
+
+    std::vector<ColumnStats> columns;
+    std::atomic<uint64_t> rows{0u};
+    // rows --dedup and sampling dropped, counted in rows as well.
+    std::atomic<uint64_t> duplicates{0u};
+    std::atomic<uint64_t> sampled_out{0u};
+    std::atomic<uint64_t> bytes_in{0u};
+    std::atomic<uint64_t> bytes_out{0u};
+};
+
+// A column as it is named in the summary.
+struct StatsColumn {
+    size_t index;
+    const char* type;
+};
+
+// The per worker counters of a run, summed into JSON snapshots on demand.
+class RunStats {
+public:
+    explicit RunStats(std::vector<StatsColumn> columns)
+        : _columns(std::move(columns)), _start(std::chrono::steady_clock::now()) {}
+
+    // a new set of counters for one worker; it lives as long as the run.
+    ThreadStats* add_thread() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _threads.emplace_back(new ThreadStats(_columns.size()));
+        return _threads.back().get();
+    }
+
+    // One JSON object: rows, bytes, diagnostics by kind and the counters of
+    // every column, summed per column type as well.
+    void write_json(OutputBuffer& out, const DiagnosticCounters& diagnostics, bool final) {
+        struct Totals {
+            uint64_t cells = 0u, nulls = 0u, failures = 0u, timed_cells = 0u, timed_ns = 0u;
+
+            uint64_t time_ns() const {
+                return timed_cells == 0u ? 0u : static_cast<uint64_t>(
+                    static_cast<double>(timed_ns) * cells / timed_cells);
+            }
+        };
+        std::vector<Totals> columns(_columns.size());
+        uint64_t rows = 0u, duplicates = 0u, sampled_out = 0u, bytes_in = 0u, bytes_out = 0u;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (const auto& thread : _threads) {
+                rows += thread->rows.load(std::memory_order_relaxed);
+                duplicates += thread->duplicates.load(std::memory_order_relaxed);
+                sampled_out += thread->sampled_out.load(std::memory_order_relaxed);
+                bytes_in += thread->bytes_in.load(std::memory_order_relaxed);
+                bytes_out += thread->bytes_out.load(std::memory_order_relaxed);
+                for (size_t i = 0u; i < columns.size(); ++i) {
+                    const ColumnStats& c = thread->columns[i];
+                    columns[i].cells += c.cells.load(std::memory_order_relaxed);
+                    columns[i].nulls += c.nulls.load(std::memory_order_relaxed);
+                    columns[i].failures += c.failures.load(std::memory_order_relaxed);
+                    columns[i].timed_cells += c.timed_cells.load(std::memory_order_relaxed);
+                    columns[i].timed_ns += c.timed_ns.load(std::memory_order_relaxed);
+                }
+            }
+        }
+        double elapsed = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - _start).count();
+        auto write_totals = [&out](const Totals& t) {
+            out << "\"cells\":" << t.cells << ",\"nulls\":" << t.nulls << ",\"failures\":"
+                << t.failures << ",\"time_ns\":" << t.time_ns();
+        };
+
+        out << "{\"final\":" << (final ? "true" : "false") << ",\"elapsed_sec\":" << elapsed
+            << ",\"rows\":" << rows << ",\"duplicates\":" << duplicates << ",\"sampled_out\":"
+            << sampled_out << ",\"bytes_in\":" << bytes_in << ",\"bytes_out\":" << bytes_out
+            << ",\"diagnostics\":{";
+        for (int kind = 0; kind < DIAG_KIND_COUNT; ++kind) {
+            out << (kind ? "," : "") << '"' << DIAG_NAMES[kind] << "\":"
+                << diagnostics.count(static_cast<DiagKind>(kind));
+        }
+        out << "},\"columns\":[";
+        std::vector<std::pair<const char*, Totals>> types;
+        for (size_t i = 0u; i < columns.size(); ++i) {
+            out << (i ? "," : "") << "{\"index\":" << _columns[i].index << ",\"type\":\""
+                << _columns[i].type << "\",";
+            write_totals(columns[i]);
+            out << '}';
+            size_t t = 0u;
+            while (t < types.size() && types[t].first != _columns[i].type) {
+                ++t;
+            }
+            if (t == types.size()) {
+                types.push_back(std::make_pair(_columns[i].type, Totals()));
+            }
+            Totals& type = types[t].second;
+            type.cells += columns[i].cells;
+            type.nulls += columns[i].nulls;
+            type.failures += columns[i].failures;
+            type.timed_cells += columns[i].timed_cells;
+            type.timed_ns += columns[i].timed_ns;
+        }
+        out << "],\"types\":{";
+        for (size_t t = 0u; t < types.size(); ++t) {
+            out << (t ? "," : "") << '"' << types[t].first << "\":{";
+            write_totals(types[t].second);
+            out << '}';
+        }
+        out << "}}\n";
+    }
+
+    // Replaces `path` through a temporary file, so readers never see a
+    // partial snapshot.
+    int write_file(const std::string& path, const DiagnosticCounters& diagnostics, bool final) {
+        OutputBuffer json;
+        write_json(json, diagnostics, final);
+        std::string tmp = path + ".tmp";
+        FILE* file = fopen(tmp.c_str(), "w");
+        if (file == nullptr) {
+            std::cerr << "Open stats file [" << tmp << "] failed." << std::endl;
+            return -1;
+        }
+        bool ok = fwrite(json.data(), 1, json.size(), file) == json.size();
+        ok = (fclose(file) == 0) && ok;
+        if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+            std::cerr << "write stats file [" << path << "] failed." << std::endl;
+            remove(tmp.c_str());
+            return -1;
+        }
+        return 0;
+    }
+
+private:
+    const std::vector<StatsColumn> _columns;
+    const std::chrono::steady_clock::time_point _start;
+    std::mutex _mutex;
+    std::vector<std::unique_ptr<ThreadStats>> _threads;
+};
+
+// Rewrites the --stats file every `interval` seconds (never with 0) and
+// whenever the process gets SIGUSR1. start() blocks SIGUSR1 in the calling
+// thread, so it has to run before any other thread is started; they inherit
+// the mask and the signal is only ever taken by the reporter.
+class StatsReporter {
+public:
+    StatsReporter(RunStats& stats, const DiagnosticCounters& diagnostics, std::string path,
+            double interval)
+        : _stats(stats), _diagnostics(diagnostics), _path(std::move(path)),
+          _interval(interval) {}
+
+    StatsReporter(const StatsReporter&) = delete;
+    StatsReporter& operator=(const StatsReporter&) = delete;
+
+    ~StatsReporter() {
+        stop();
+    }
+
+    int start() {
+        sigemptyset(&_signals);
+        sigaddset(&_signals, SIGUSR1);
+        if (pthread_sigmask(SIG_BLOCK, &_signals, nullptr) != 0) {
+            std::cerr << "block SIGUSR1 failed." << std::endl;
+            return -1;
+        }
+        _thread = std::thread(&StatsReporter::run, this);
+        return 0;
+    }
+
+    void stop() {
+        if (!_thread.joinable()) {
+            return;
+        }
+        _stopping.store(true);
+        pthread_kill(_thread.native_handle(), SIGUSR1);
+        _thread.join();
+    }
+
+private:
+    void run() {
+        while (true) {
+            int ret = 0;
+            if (_interval > 0.0) {
+                timespec timeout;
+                timeout.tv_sec = static_cast<time_t>(_interval);
+                timeout.tv_nsec = static_cast<long>((_interval - timeout.tv_sec) * 1e9);
+                ret = sigtimedwait(&_signals, nullptr, &timeout);
+            } else {
+                int signal = 0;
+                ret = sigwait(&_signals, &signal) == 0 ? SIGUSR1 : -1;
+            }
+            if (_stopping.load()) {
+                return;
+            }
+            if (ret == SIGUSR1 || (ret < 0 && errno == EAGAIN)) {
+                _stats.write_file(_path, _diagnostics, false);
+            }
+        }
+    }
+
+    RunStats& _stats;
+    const DiagnosticCounters& _diagnostics;
+    const std::string _path;
+    const double _interval;
+    sigset_t _signals;
+    std::atomic<bool> _stopping{false};
+    std::thread _thread;
+};
+
+#endif // DATA_CLEANER_RUN_STATS_H
@@ -0,0 +1,119 @@
+#ifndef DATA_CLEANER_SPACE_SAVING_H
+#define DATA_CLEANER_SPACE_SAVING_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "str_view.h"
+
+// Space-saving top-k summary (Metwally et al.): at most `capacity` counted
+// values. An unseen value takes over the entry with the smallest count and
+// inherits that count as its possible overestimate, so any value seen more
+// often than n / capacity times is kept. Values are keyed by their hash and
+// keep their first text for the report.
+class SpaceSaving {
+public:
+    struct Entry {
+        uint64_t key;
+        uint64_t count;
+        uint64_t error;
+        std::string text;
+    };
+
+    explicit SpaceSaving(size_t capacity = 64u) : _capacity(capacity) {}
+
+    void add(uint64_t key, StrView text) {
+        auto it = _index.find(key);
+        if (it != _index.end()) {
+            ++_entries[it->second].count;
+            return;
+        }
+        if (_entries.size() < _capacity) {
+            _index[key] = _entries.size();
+            _entries.push_back(Entry{key, 1u, 0u, to_string(text)});
+            return;
+        }
+        size_t min = 0u;
+        for (size_t i = 1u; i < _entries.size(); ++i) {
+            if (_entries[i].count < _entries[min].count) {
+                min = i;
+            }
+        }
+        Entry& entry = _entries[min];
+        _index.erase(entry.key);
+        _index[key] = min;
+        entry.key = key;
+        entry.error = entry.count;
+        ++entry.count;
+        entry.text.assign(text.data, text.size);
+    }
+
+    // Mergeable summaries (Agarwal et al.): a value missing from a full
+    // summary may have been counted up to its smallest count.
+    void merge(const SpaceSaving& other) {
+        uint64_t own_floor = floor(), other_floor = other.floor();
+        std::vector<Entry> merged;
+        for (const auto& entry : _entries) {
+            merged.push_back(entry);
+            const Entry* match = other.find(entry.key);
+            merged.back().count += match != nullptr ? match->count : other_floor;
+            merged.back().error += match != nullptr ? match->error : other_floor;
+        }
+        for (const auto& entry : other._entries) {
+            if (find(entry.key) == nullptr) {
+                merged.push_back(entry);
+                merged.back().count += own_floor;
+                merged.back().error += own_floor;
+            }
+        }
+        std::sort(merged.begin(), merged.end(), [](const Entry& a, const Entry& b) {
+            return a.count > b.count;
+        });
+        if (merged.size() > _capacity) {
+            merged.resize(_capacity);
+        }
+        _entries.swap(merged);
+        _index.clear();
+        for (size_t i = 0u; i < _entries.size(); ++i) {
+            _index[_entries[i].key] = i;
+        }
+    }
+
+    // the `n` most frequent values, most frequent first.
+    std::vector<Entry> top(size_t n) const {
+        std::vector<Entry> entries(_entries);
+        std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+            return a.count > b.count;
+        });
+        if (entries.size() > n) {
+            entries.resize(n);
+        }
+        return entries;
+    }
+
+private:
+    const Entry* find(uint64_t key) const {
+        auto it = _index.find(key);
+        return it == _index.end() ? nullptr : &_entries[it->second];
+    }
+
+    uint64_t floor() const {
+        if (_entries.size() < _capacity) {
+            return 0u;
+        }
+        uint64_t min = _entries[0].count;
+        for (const auto& entry : _entries) {
+            min = std::min(min, entry.count);
+        }
+        return min;
+    }
+
+    size_t _capacity;
+    std::vector<Entry> _entries;
+    std::unordered_map<uint64_t, size_t> _index;
+};
+
+#endif // DATA_CLEANER_SPACE_SAVING_H
@@ -0,0 +1,132 @@
+#ifndef DATA_CLEANER_STR_VIEW_H
+#define DATA_CLEANER_STR_VIEW_H
+
+#include <stdlib.h>
+#include <cmath>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "float_parser.h"
+
+// A length bounded, non owning view into the input. Tokens are not NUL
+// terminated, so everything that consumes them has to respect `size`.
+struct StrView {
+    const char* data;
+    size_t size;
+};
+
+inline std::ostream& operator<<(std::ostream& os, StrView str) {
+    return os.write(str.data, str.size);
+}
+
+inline bool equals(StrView str, const char* literal) {
+    size_t len = strlen(literal);
+    return str.size == len && memcmp(str.data, literal, len) == 0;
+}
+
+inline bool starts_with(StrView str, const char* literal) {
+    size_t len = strlen(literal);
+    return str.size >= len && memcmp(str.data, literal, len) == 0;
+}
+
+inline std::string to_string(StrView str) {
+    return std::string(str.data, str.size);
+}
+
+inline StrView trim(StrView token) {
+    const char* begin = token.data;
+    const char* end = token.data + token.size;
+    while (begin != end && *begin == ' ') {
+        ++begin;
+    }
+    while (end != begin && *(end - 1) == ' ') {
+        --end;
+    }
+    return StrView{begin, static_cast<size_t>(end - begin)};
+}
+
+inline void trim_tokens(std::vector<StrView>& tokens) {
+    for (auto& token : tokens) {
+        token = trim(token);
+    }
+}
+
+// Like split(), into a reused vector.
+inline void split_into(StrView str, char delim, std::vector<StrView>& tokens) {
+    tokens.clear();
+    const char* begin = str.data;
+    const char* end = str.data + str.size;
+    while (true) {
+        const char* pos = static_cast<const char*>(memchr(begin, delim, end - begin));
+        if (pos == nullptr) {
+            tokens.push_back({begin, static_cast<size_t>(end - begin)});
+            break;
+        }
+        tokens.push_back({begin, static_cast<size_t>(pos - begin)});
+        begin = pos + 1;
+    }
+    trim_tokens(tokens);
+}
+
+inline std::vector<StrView> split(StrView str, char delim) {
+    std::vector<StrView> tokens;
+    split_into(str, delim, tokens);
+    return tokens;
+}
+
+// The first two parts of split(token, delim), trimmed the same way, without
+// building a vector; `second` is empty if there is no delimiter. Returns the
+// number of parts, 3 standing for "more than two".
+inline size_t split_pair(StrView token, char delim, StrView& first, StrView& second) {
+    const char* end = token.data + token.size;
+    const char* pos = static_cast<const char*>(memchr(token.data, delim, token.size));
+    if (pos == nullptr) {
+        first = trim(token);
+        second = StrView{end, 0u};
+        return 1u;
+    }
+    first = trim(StrView{token.data, static_cast<size_t>(pos - token.data)});
+    const char* next = static_cast<const char*>(memchr(pos + 1, delim, end - pos - 1));
+    second = trim(StrView{pos + 1, static_cast<size_t>((next != nullptr ? next : end) - pos - 1)});
+    return next != nullptr ? 3u : 2u;
+}
+
+// strtod over a view, see parse_float.
+inline double view_strtod(StrView str, size_t* consumed = nullptr) {
+    double value = 0.0;
+    size_t length = parse_float(str.data, str.size, value);
+    if (consumed != nullptr) {
+        *consumed = length;
+    }
+    return value;
+}
+
+// Whether the whole, non empty view is a number. A finite literal that
+// overflows to infinity is none. `value` gets what strtod would read either
+// way.
+inline bool parse_number(StrView str, double& value) {
+    if (str.size == 0u || parse_float(str.data, str.size, value) != str.size) {
+        return false;
+    }
+    return !std::isinf(value) || !is_float_digit(str.data[str.size - 1]);
+}
+
+// Whether the whole, non empty view is a decimal count that fits `value`.
+inline bool parse_count(StrView str, size_t& value) {
+    value = 0u;
+    if (str.size == 0u) {
+        return false;
+    }
+    for (size_t i = 0u; i < str.size; ++i) {
+        unsigned digit = static_cast<unsigned char>(str.data[i]) - '0';
+        if (digit > 9u || value > (static_cast<size_t>(-1) - digit) / 10u) {
+            return false;
+        }
+        value = value * 10u + digit;
+    }
+    return true;
+}
+
+#endif // DATA_CLEANER_STR_VIEW_H
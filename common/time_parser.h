@@ -0,0 +1,156 @@
+#ifndef DATA_CLEANER_TIME_PARSER_H
+#define DATA_CLEANER_TIME_PARSER_H
+
+#include <stdint.h>
+#include <ctime>
+#include <limits>
+#include <string>
+
+#include "str_view.h"
+
+// Time# formats with a dedicated parser. Everything else goes through
+// std::get_time + std::mktime.
+enum TimeLayout : int {
+    TIME_GENERIC = 0,
+    TIME_DATE_TIME = 1,     // %Y-%m-%d %H:%M:%S
+    TIME_DATE_T_TIME = 2,   // %Y-%m-%dT%H:%M:%S
+    TIME_COMPACT_DATE = 3,  // %Y%m%d
+    TIME_EPOCH = 4          // %s, seconds since the epoch
+};
+
+inline TimeLayout compile_time_format(const std::string& format) {
+    if (format == "%Y-%m-%d %H:%M:%S") {
+        return TIME_DATE_TIME;
+    } else if (format == "%Y-%m-%dT%H:%M:%S") {
+        return TIME_DATE_T_TIME;
+    } else if (format == "%Y%m%d") {
+        return TIME_COMPACT_DATE;
+    } else if (format == "%s") {
+        return TIME_EPOCH;
+    }
+    return TIME_GENERIC;
+}
+
+// Days since 1970-01-01 of a proleptic Gregorian date. Linear in `d`, so an
+// out of range day (Feb 30) rolls over into the next month like mktime does.
+inline int64_t days_from_civil(int64_t y, unsigned m, unsigned d) {
+    y -= m <= 2u;
+    const int64_t era = (y >= 0 ? y : y - 399) / 400;
+    const unsigned yoe = static_cast<unsigned>(y - era * 400);
+    const unsigned doy = (153u * (m > 2u ? m - 3u : m + 9u) + 2u) / 5u + d - 1u;
+    const unsigned doe = yoe * 365u + yoe / 4u - yoe / 100u + doy;
+    return era * 146097 + static_cast<int64_t>(doe) - 719468;
+}
+
+// mktime(tm_isdst = 0) minus plain civil arithmetic, cached per local hour.
+// mktime consults the zone rules on every call, but they only change on
+// hour boundaries, so one mktime per distinct hour gives identical results.
+class LocalTimeCache {
+public:
+    LocalTimeCache() {
+        for (size_t i = 0u; i < SLOTS; ++i) {
+            _keys[i] = std::numeric_limits<int64_t>::min();
+        }
+    }
+
+    // returns false when mktime cannot represent the hour.
+    bool delta(int64_t days, int year, int month, int day, int hour, int64_t& delta) {
+        int64_t key = days * 24 + hour;
+        size_t slot = static_cast<size_t>(key) & (SLOTS - 1u);
+        if (_keys[slot] != key) {
+            std::tm tm = {};
+            tm.tm_year = year - 1900;
+            tm.tm_mon = month - 1;
+            tm.tm_mday = day;
+            tm.tm_hour = hour;
+            time_t t = std::mktime(&tm);
+            if (t == (time_t)-1) {
+                return false;
+            }
+            _keys[slot] = key;
+            _deltas[slot] = static_cast<int64_t>(t) - key * 3600;
+        }
+        delta = _deltas[slot];
+        return true;
+    }
+
+private:
+    static const size_t SLOTS = 4096u;
+    int64_t _keys[SLOTS];
+    int64_t _deltas[SLOTS];
+};
+
+inline bool parse_fixed_digits(const char* p, size_t n, int& value) {
+    value = 0;
+    for (size_t i = 0u; i < n; ++i) {
+        unsigned digit = static_cast<unsigned char>(p[i]) - '0';
+        if (digit > 9u) {
+            return false;
+        }
+        value = value * 10 + static_cast<int>(digit);
+    }
+    return true;
+}
+
+inline bool parse_epoch_seconds(StrView str, time_t& result) {
+    size_t i = str.size > 0u && str.data[0] == '-' ? 1u : 0u;
+    if (str.size == i || str.size - i > 18u) {
+        return false;
+    }
+    int64_t value = 0;
+    for (; i < str.size; ++i) {
+        unsigned digit = static_cast<unsigned char>(str.data[i]) - '0';
+        if (digit > 9u) {
+            return false;
+        }
+        value = value * 10 + digit;
+    }
+    result = str.data[0] == '-' ? -value : value;
+    return true;
+}
+
+// Parses `str` with one of the dedicated layouts. Only strictly well formed
+// values are accepted; false means the caller has to take the
+// std::get_time path, which then decides (and reports) the result, so the
+// output is the same as if every value went through it.
+inline bool parse_time_fast(StrView str, TimeLayout layout, LocalTimeCache& cache,
+        time_t& result) {
+    int year = 0, month = 0, day = 0, hour = 0, minute = 0, second = 0;
+    const char* p = str.data;
+    switch (layout) {
+    case TIME_EPOCH:
+        return parse_epoch_seconds(str, result);
+    case TIME_COMPACT_DATE:
+        if (str.size != 8u || !parse_fixed_digits(p, 4u, year) ||
+                !parse_fixed_digits(p + 4, 2u, month) || !parse_fixed_digits(p + 6, 2u, day)) {
+            return false;
+        }
+        break;
+    case TIME_DATE_TIME:
+    case TIME_DATE_T_TIME:
+        if (str.size != 19u || p[4] != '-' || p[7] != '-' ||
+                p[10] != (layout == TIME_DATE_TIME ? ' ' : 'T') ||
+                p[13] != ':' || p[16] != ':' ||
+                !parse_fixed_digits(p, 4u, year) || !parse_fixed_digits(p + 5, 2u, month) ||
+                !parse_fixed_digits(p + 8, 2u, day) || !parse_fixed_digits(p + 11, 2u, hour) ||
+                !parse_fixed_digits(p + 14, 2u, minute) || !parse_fixed_digits(p + 17, 2u, second)) {
+            return false;
+        }
+        break;
+    default:
+        return false;
+    }
+    if (month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || minute > 59 ||
+            second > 59) {
+        return false;
+    }
+    int64_t days = days_from_civil(year, month, day);
+    int64_t delta = 0;
+    if (!cache.delta(days, year, month, day, hour, delta)) {
+        return false;
+    }
+    result = static_cast<time_t>((days * 24 + hour) * 3600 + delta + minute * 60 + second);
+    return true;
+}
+
+#endif // DATA_CLEANER_TIME_PARSER_H
@@ -0,0 +1,501 @@
+#ifndef DATA_CLEANER_TOKENIZER_H
+#define DATA_CLEANER_TOKENIZER_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DATA_CLEANER_X86 1
+#endif
+
+#include "str_view.h"
+
+// The set of bytes the tokenizer indexes: the field delimiter and every sub
+// delimiter used by the schema.
+struct DelimSet {
+    static const size_t MAX_DELIMS = 8u;
+    char chars[MAX_DELIMS];
+    size_t count = 0u;
+    bool table[256] = {};
+
+    bool add(char c) {
+        if (contains(c)) {
+            return true;
+        }
+        if (count == MAX_DELIMS) {
+            return false;
+        }
+        chars[count++] = c;
+        table[static_cast<unsigned char>(c)] = true;
+        return true;
+    }
+
+    bool contains(char c) const {
+        return table[static_cast<unsigned char>(c)];
+    }
+};
+
+// Writes the offset of every byte of data[begin, size) that is in `set` to
+// `positions` (which must have room for size - begin entries) and returns how
+// many were found.
+typedef size_t (*ScanDelimsFn)(const char* data, size_t begin, size_t size,
+        const DelimSet& set, uint32_t* positions);
+
+inline size_t scan_delims_scalar(const char* data, size_t begin, size_t size,
+        const DelimSet& set, uint32_t* positions) {
+    size_t n = 0u;
+    for (size_t i = begin; i < size; ++i) {
+        positions[n] = i;
+        n += set.contains(data[i]);
+    }
+    return n;
+}
+
+#ifdef DATA_CLEANER_X86
+inline size_t scan_delims_sse2(const char* data, size_t begin, size_t size,
+        const DelimSet& set, uint32_t* positions) {
+    __m128i needles[DelimSet::MAX_DELIMS];
+    for (size_t k = 0u; k < set.count; ++k) {
+        needles[k] = _mm_set1_epi8(set.chars[k]);
+    }
+    size_t n = 0u;
+    size_t i = begin;
+    for (; i + 16u <= size; i += 16u) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i hits = _mm_setzero_si128();
+        for (size_t k = 0u; k < set.count; ++k) {
+            hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, needles[k]));
+        }
+        uint32_t mask = _mm_movemask_epi8(hits);
+        while (mask != 0u) {
+            positions[n++] = i + __builtin_ctz(mask);
+            mask &= mask - 1u;
+        }
+    }
+    return n + scan_delims_scalar(data, i, size, set, positions + n);
+}
+
+__attribute__((target("avx2")))
+inline size_t scan_delims_avx2(const char* data, size_t begin, size_t size,
+        const DelimSet& set, uint32_t* positions) {
+    __m256i needles[DelimSet::MAX_DELIMS];
+    for (size_t k = 0u; k < set.count; ++k) {
+        needles[k] = _mm256_set1_epi8(set.chars[k]);
+    }
+    size_t n = 0u;
+    size_t i = begin;
+    for (; i + 64u <= size; i += 64u) {
+        __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 32u));
+        __m256i lo_hits = _mm256_setzero_si256();
+        __m256i hi_hits = _mm256_setzero_si256();
+        for (size_t k = 0u; k < set.count; ++k) {
+            lo_hits = _mm256_or_si256(lo_hits, _mm256_cmpeq_epi8(lo, needles[k]));
+            hi_hits = _mm256_or_si256(hi_hits, _mm256_cmpeq_epi8(hi, needles[k]));
+        }
+        uint64_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(lo_hits)) |
+            static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(hi_hits))) << 32;
+        while (mask != 0u) {
+            positions[n++] = i + __builtin_ctzll(mask);
+            mask &= mask - 1u;
+        }
+    }
+    return n + scan_delims_sse2(data, i, size, set, positions + n);
+}
+#endif
+
+// Picks the widest scanner the CPU supports, once per process.
+inline ScanDelimsFn select_scan_delims() {
+#ifdef DATA_CLEANER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return scan_delims_avx2;
+    }
+    return scan_delims_sse2;
+#else
+    return scan_delims_scalar;
+#endif
+}
+
+inline ScanDelimsFn scan_delims() {
+    static const ScanDelimsFn fn = select_scan_delims();
+    return fn;
+}
+
+// Counts the bytes of data[begin, size) equal to `c`.
+typedef size_t (*CountByteFn)(const char* data, size_t begin, size_t size, char c);
+
+inline size_t count_byte_scalar(const char* data, size_t begin, size_t size, char c) {
+    size_t n = 0u;
+    for (size_t i = begin; i < size; ++i) {
+        n += data[i] == c;
+    }
+    return n;
+}
+
+#ifdef DATA_CLEANER_X86
+inline size_t count_byte_sse2(const char* data, size_t begin, size_t size, char c) {
+    const __m128i needle = _mm_set1_epi8(c);
+    size_t n = 0u;
+    size_t i = begin;
+    for (; i + 16u <= size; i += 16u) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        n += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(block, needle)));
+    }
+    return n + count_byte_scalar(data, i, size, c);
+}
+
+__attribute__((target("avx2,popcnt")))
+inline size_t count_byte_avx2(const char* data, size_t begin, size_t size, char c) {
+    const __m256i needle = _mm256_set1_epi8(c);
+    size_t n = 0u;
+    size_t i = begin;
+    for (; i + 64u <= size; i += 64u) {
+        __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 32u));
+        uint64_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, needle))) |
+            static_cast<uint64_t>(static_cast<uint32_t>(
+                _mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, needle)))) << 32;
+        n += __builtin_popcountll(mask);
+    }
+    return n + count_byte_sse2(data, i, size, c);
+}
+#endif
+
+inline CountByteFn select_count_byte() {
+#ifdef DATA_CLEANER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+        return count_byte_avx2;
+    }
+    return count_byte_sse2;
+#else
+    return count_byte_scalar;
+#endif
+}
+
+inline CountByteFn count_byte() {
+    static const CountByteFn fn = select_count_byte();
+    return fn;
+}
+
+// Writes the offset of every `target` byte of data[begin, size) that is not
+// between double quotes to `positions` and returns how many were found. A
+// doubled quote inside a quoted field toggles twice and so changes nothing.
+// `in_quotes` carries the quote state in and out, so a buffer can be
+// scanned in pieces. The vector versions track the state simdcsv style: a
+// bitmask of the quotes of a 64 byte block turns into the mask of the bytes
+// between quotes by a prefix xor.
+typedef size_t (*ScanUnquotedFn)(const char* data, size_t begin, size_t size, char target,
+        bool& in_quotes, uint32_t* positions);
+
+inline size_t scan_unquoted_scalar(const char* data, size_t begin, size_t size, char target,
+        bool& in_quotes, uint32_t* positions) {
+    size_t n = 0u;
+    bool inside = in_quotes;
+    for (size_t i = begin; i < size; ++i) {
+        inside ^= data[i] == '"';
+        positions[n] = i;
+        n += !inside && data[i] == target;
+    }
+    in_quotes = inside;
+    return n;
+}
+
+// bit i of the result is the xor of bits 0..i of `mask`.
+inline uint64_t prefix_xor(uint64_t mask) {
+    mask ^= mask << 1;
+    mask ^= mask << 2;
+    mask ^= mask << 4;
+    mask ^= mask << 8;
+    mask ^= mask << 16;
+    mask ^= mask << 32;
+    return mask;
+}
+
+// The offsets of the set bits of `mask`, starting at `base`.
+inline size_t write_mask_positions(uint64_t mask, size_t base, uint32_t* positions) {
+    size_t n = 0u;
+    while (mask != 0u) {
+        positions[n++] = base + __builtin_ctzll(mask);
+        mask &= mask - 1u;
+    }
+    return n;
+}
+
+#ifdef DATA_CLEANER_X86
+inline uint64_t byte_mask_sse2(const char* data, __m128i needle) {
+    uint64_t mask = 0u;
+    for (int k = 0; k < 4; ++k) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16 * k));
+        mask |= static_cast<uint64_t>(static_cast<uint32_t>(
+            _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle)))) << (16 * k);
+    }
+    return mask;
+}
+
+inline size_t scan_unquoted_sse2(const char* data, size_t begin, size_t size, char target,
+        bool& in_quotes, uint32_t* positions) {
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i needle = _mm_set1_epi8(target);
+    uint64_t carry = in_quotes ? ~0ull : 0u;
+    size_t n = 0u;
+    size_t i = begin;
+    for (; i + 64u <= size; i += 64u) {
+        uint64_t inside = prefix_xor(byte_mask_sse2(data + i, quote)) ^ carry;
+        carry = static_cast<uint64_t>(static_cast<int64_t>(inside) >> 63);
+        n += write_mask_positions(byte_mask_sse2(data + i, needle) & ~inside, i, positions + n);
+    }
+    in_quotes = carry != 0u;
+    return n + scan_unquoted_scalar(data, i, size, target, in_quotes, positions + n);
+}
+
+__attribute__((target("avx2")))
+inline uint64_t byte_mask_avx2(const char* data, __m256i needle) {
+    __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+    __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + 32));
+    return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, needle))) |
+        static_cast<uint64_t>(static_cast<uint32_t>(
+            _mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, needle)))) << 32;
+}
+
+// the prefix xor as a carry-less multiplication by all ones.
+__attribute__((target("avx2,pclmul")))
+inline size_t scan_unquoted_avx2(const char* data, size_t begin, size_t size, char target,
+        bool& in_quotes, uint32_t* positions) {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i needle = _mm256_set1_epi8(target);
+    const __m128i ones = _mm_set1_epi8(static_cast<char>(0xff));
+    uint64_t carry = in_quotes ? ~0ull : 0u;
+    size_t n = 0u;
+    size_t i = begin;
+    for (; i + 64u <= size; i += 64u) {
+        uint64_t quotes = byte_mask_avx2(data + i, quote);
+        uint64_t inside = static_cast<uint64_t>(_mm_cvtsi128_si64(_mm_clmulepi64_si128(
+            _mm_set_epi64x(0, static_cast<int64_t>(quotes)), ones, 0))) ^ carry;
+        carry = static_cast<uint64_t>(static_cast<int64_t>(inside) >> 63);
+        n += write_mask_positions(byte_mask_avx2(data + i, needle) & ~inside, i, positions + n);
+    }
+    in_quotes = carry != 0u;
+    return n + scan_unquoted_scalar(data, i, size, target, in_quotes, positions + n);
+}
+#endif
+
+inline ScanUnquotedFn select_scan_unquoted() {
+#ifdef DATA_CLEANER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("pclmul")) {
+        return scan_unquoted_avx2;
+    }
+    return scan_unquoted_sse2;
+#else
+    return scan_unquoted_scalar;
+#endif
+}
+
+inline ScanUnquotedFn scan_unquoted() {
+    static const ScanUnquotedFn fn = select_scan_unquoted();
+    return fn;
+}
+
+// Splits lines with one vectorized pass per line: the offsets of the field
+// delimiter and of all sub delimiters are collected into a reusable index,
+// and fields / sub fields are then cut from that index without rescanning
+// the bytes. Every returned token is trimmed of surrounding spaces and the
+// returned vectors are reused by the next call of the same method, so one
+// Tokenizer belongs to one thread.
+//
+// A `quoted` Tokenizer reads RFC 4180 fields: a field delimiter between
+// double quotes is part of the field, and a field enclosed in quotes comes
+// back without them and with "" unescaped. Its sub fields are cut with
+// memchr, as quoted fields may not be part of the line.
+class Tokenizer {
+public:
+    // bytes indexed at a time by a projected split_line.
+    static const size_t SCAN_BLOCK = 256u;
+
+    Tokenizer(char field_delim, const std::vector<char>& sub_delims, bool quoted = false)
+        : _field_delim(field_delim), _quoted(quoted), _scan(scan_delims()),
+          _count_byte(count_byte()), _scan_unquoted(scan_unquoted()) {
+        _delims.add(field_delim);
+        for (char delim : sub_delims) {
+            _delims.add(delim);
+        }
+    }
+
+    // Restricts split_line to the fields flagged in `needed`. The index
+    // stops at the end of the last needed field and the remaining fields
+    // are only counted; fields that are not needed are neither trimmed nor
+    // indexed beyond that point, and those after the last needed one come
+    // back empty. An empty `needed` splits every field again.
+    void project(const std::vector<bool>& needed) {
+        _projected = !needed.empty();
+        _needed.assign(needed.begin(), needed.end());
+        while (!_needed.empty() && !_needed.back()) {
+            _needed.pop_back();
+        }
+    }
+
+    const std::vector<StrView>& split_line(StrView line) {
+        _line = line;
+        if (_positions.size() < line.size) {
+            _positions.resize(line.size);
+        }
+        if (_quoted) {
+            return split_quoted(line);
+        }
+        if (_projected) {
+            return split_projected(line);
+        }
+        _count = _scan(line.data, 0u, line.size, _delims, _positions.data());
+        _fields.clear();
+        const char* begin = line.data;
+        for (size_t k = 0u; k < _count; ++k) {
+            const char* pos = line.data + _positions[k];
+            if (*pos == _field_delim) {
+                _fields.push_back({begin, static_cast<size_t>(pos - begin)});
+                begin = pos + 1;
+            }
+        }
+        _fields.push_back({begin, static_cast<size_t>(line.data + line.size - begin)});
+        trim_tokens(_fields);
+        return _fields;
+    }
+
+    // first level, e.g. the values of a multi valued field.
+    const std::vector<StrView>& split_field(StrView token, char delim) {
+        split(token, delim, _subfields);
+        return _subfields;
+    }
+
+    // second level, e.g. the CAT and VALUE of one CAT:VALUE pair.
+    const std::vector<StrView>& split_subfield(StrView token, char delim) {
+        split(token, delim, _parts);
+        return _parts;
+    }
+
+private:
+    // Projection only spares the fields that are not needed the unquoting;
+    // the quote state needs every byte of the line anyway.
+    const std::vector<StrView>& split_quoted(StrView line) {
+        bool in_quotes = false;
+        _count = _scan_unquoted(line.data, 0u, line.size, _field_delim, in_quotes,
+                _positions.data());
+        _unescaped.clear();
+        _unescaped.reserve(line.size);
+        _fields.clear();
+        const char* begin = line.data;
+        for (size_t k = 0u; k <= _count; ++k) {
+            const char* end = k < _count ? line.data + _positions[k] : line.data + line.size;
+            StrView field = {begin, static_cast<size_t>(end - begin)};
+            size_t i = _fields.size();
+            if (!_projected || (i < _needed.size() && _needed[i])) {
+                field = unquote(trim(field));
+            }
+            _fields.push_back(field);
+            begin = end + 1;
+        }
+        return _fields;
+    }
+
+    // The content of a field enclosed in double quotes. Unescaped fields
+    // live in _unescaped, which split_quoted reserves for the whole line so
+    // that they do not move.
+    StrView unquote(StrView field) {
+        if (field.size < 2u || field.data[0] != '"' || field.data[field.size - 1] != '"') {
+            return field;
+        }
+        StrView inner = {field.data + 1, field.size - 2u};
+        if (memchr(inner.data, '"', inner.size) == nullptr) {
+            return inner;
+        }
+        size_t offset = _unescaped.size();
+        for (size_t i = 0u; i < inner.size; ++i) {
+            _unescaped.push_back(inner.data[i]);
+            i += inner.data[i] == '"' && i + 1 < inner.size && inner.data[i + 1] == '"';
+        }
+        return StrView{_unescaped.data() + offset, _unescaped.size() - offset};
+    }
+
+    const std::vector<StrView>& split_projected(StrView line) {
+        // index whole blocks until the last needed field is closed.
+        size_t wanted = _needed.size();
+        size_t scanned = 0u;
+        size_t closed = 0u;
+        _count = 0u;
+        while (closed < wanted && scanned < line.size) {
+            size_t next = std::min(scanned + SCAN_BLOCK, line.size);
+            _count += _scan(line.data, scanned, next, _delims, _positions.data() + _count);
+            closed += _count_byte(line.data, scanned, next, _field_delim);
+            scanned = next;
+        }
+        _fields.clear();
+        const char* begin = line.data;
+        const uint8_t* needed = _needed.data();
+        for (size_t k = 0u, n = 0u; k < _count && n < wanted; ++k) {
+            const char* pos = line.data + _positions[k];
+            if (*pos == _field_delim) {
+                StrView field = {begin, static_cast<size_t>(pos - begin)};
+                _fields.push_back(needed[n++] ? trim(field) : field);
+                begin = pos + 1;
+            }
+        }
+        if (_fields.size() < wanted) {
+            StrView field = {begin, static_cast<size_t>(line.data + line.size - begin)};
+            _fields.push_back(needed[_fields.size()] ? trim(field) : field);
+        } else {
+            // every needed field is cut; the rest is only counted.
+            size_t rest = 1u + (closed - wanted) +
+                _count_byte(line.data, scanned, line.size, _field_delim);
+            _fields.resize(_fields.size() + rest, StrView{line.data + line.size, 0u});
+        }
+        return _fields;
+    }
+
+    void split(StrView token, char delim, std::vector<StrView>& tokens) const {
+        tokens.clear();
+        size_t begin = token.data - _line.data;
+        size_t end = begin + token.size;
+        if (_quoted || !_delims.contains(delim) || token.data < _line.data ||
+                end > _line.size) {
+            // not covered by the index, fall back to a plain scan.
+            split_into(token, delim, tokens);
+            return;
+        }
+        const uint32_t* pos = std::lower_bound(_positions.data(), _positions.data() + _count,
+                static_cast<uint32_t>(begin));
+        const uint32_t* last = _positions.data() + _count;
+        const char* start = token.data;
+        for (; pos != last && *pos < end; ++pos) {
+            const char* p = _line.data + *pos;
+            if (*p == delim) {
+                tokens.push_back({start, static_cast<size_t>(p - start)});
+                start = p + 1;
+            }
+        }
+        tokens.push_back({start, static_cast<size_t>(token.data + token.size - start)});
+        trim_tokens(tokens);
+    }
+
+    char _field_delim;
+    bool _quoted;
+    DelimSet _delims;
+    ScanDelimsFn _scan;
+    CountByteFn _count_byte;
+    ScanUnquotedFn _scan_unquoted;
+    std::string _unescaped;
+    bool _projected = false;
+    std::vector<uint8_t> _needed;
+    StrView _line = {"", 0u};
+    std::vector<uint32_t> _positions;
+    size_t _count = 0u;
+    std::vector<StrView> _fields;
+    std::vector<StrView> _subfields;
+    std::vector<StrView> _parts;
+};
+
+#endif // DATA_CLEANER_TOKENIZER_H
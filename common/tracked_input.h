@@ -0,0 +1,386 @@
+#ifndef DATA_CLEANER_TRACKED_INPUT_H
+#define DATA_CLEANER_TRACKED_INPUT_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+
+#include "compression.h"
+#include "output_sinks.h"
+
+// How far a --checkpoint run over --input got: the first input_offset bytes
+// (`rows` records) are cleaned, and the output files end at `outputs`.
+struct Checkpoint {
+    std::string input;
+    uint64_t input_offset = 0u;
+    uint64_t rows = 0u;
+    SinkOffsets outputs;
+
+    // "key\tvalue" lines.
+    int load(const char* path) {
+        FILE* file = fopen(path, "r");
+        if (file == nullptr) {
+            std::cerr << "Open checkpoint [" << path << "] failed." << std::endl;
+            return -1;
+        }
+        char line[4096];
+        int fields = 0;
+        while (fgets(line, sizeof(line), file) != nullptr) {
+            size_t size = strlen(line);
+            if (size > 0u && line[size - 1u] == '\n') {
+                line[--size] = '\0';
+            }
+            char* tab = strchr(line, '\t');
+            if (tab == nullptr) {
+                continue;
+            }
+            *tab = '\0';
+            const char* value = tab + 1;
+            if (strcmp(line, "input") == 0) {
+                input = value;
+                ++fields;
+            } else if (strcmp(line, "input_offset") == 0) {
+                fields += parse(value, input_offset);
+            } else if (strcmp(line, "rows") == 0) {
+                fields += parse(value, rows);
+            } else if (strcmp(line, "instances_offset") == 0) {
+                fields += parse(value, outputs.instances);
+            } else if (strcmp(line, "labels_offset") == 0) {
+                fields += parse(value, outputs.labels);
+            } else if (strcmp(line, "diagnostics_offset") == 0) {
+                fields += parse(value, outputs.diagnostics);
+            }
+        }
+        fclose(file);
+        if (fields != 6) {
+            std::cerr << "invalid checkpoint [" << path << "]" << std::endl;
+            return -1;
+        }
+        return 0;
+    }
+
+    // replaces the file at once, a crash leaves the previous checkpoint.
+    int save(const char* path) const {
+        std::string tmp = std::string(path) + ".tmp";
+        FILE* file = fopen(tmp.c_str(), "w");
+        if (file == nullptr) {
+            std::cerr << "Open checkpoint [" << tmp << "] failed." << std::endl;
+            return -1;
+        }
+        bool ok = fprintf(file,
+                "input\t%s\ninput_offset\t%" PRIu64 "\nrows\t%" PRIu64 "\n"
+                "instances_offset\t%" PRId64 "\nlabels_offset\t%" PRId64 "\n"
+                "diagnostics_offset\t%" PRId64 "\n",
+                input.c_str(), input_offset, rows, outputs.instances, outputs.labels,
+                outputs.diagnostics) > 0;
+        ok = fflush(file) == 0 && fdatasync(fileno(file)) == 0 && ok;
+        ok = (fclose(file) == 0) && ok;
+        if (!ok || rename(tmp.c_str(), path) != 0) {
+            std::cerr << "write checkpoint [" << path << "] failed." << std::endl;
+            remove(tmp.c_str());
+            return -1;
+        }
+        return 0;
+    }
+
+private:
+    static int parse(const char* value, uint64_t& out) {
+        char* end = nullptr;
+        out = strtoull(value, &end, 10);
+        return end != value && *end == '\0' ? 1 : 0;
+    }
+
+    static int parse(const char* value, int64_t& out) {
+        char* end = nullptr;
+        out = strtoll(value, &end, 10);
+        return end != value && *end == '\0' ? 1 : 0;
+    }
+};
+
+// Saves a Checkpoint of the run at most every `interval` seconds; the caller
+// advances it by what has been written to the sinks and asks due() at points
+// where that is everything read. Without a path it only keeps the offset.
+class Checkpointer {
+public:
+    Checkpointer(const char* path, double interval, OutputSinks& sinks, Checkpoint start)
+        : _path(path),
+          _interval(std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+              std::chrono::duration<double>(interval))),
+          _sinks(sinks),
+          _state(std::move(start)),
+          _next(std::chrono::steady_clock::now() + _interval) {}
+
+    // where reading starts.
+    uint64_t offset() const {
+        return _state.input_offset;
+    }
+
+    void advance(uint64_t bytes, uint64_t rows) {
+        _state.input_offset += bytes;
+        _state.rows += rows;
+    }
+
+    bool due() const {
+        return _path != nullptr && std::chrono::steady_clock::now() >= _next;
+    }
+
+    // the outputs go to disk before the checkpoint that points past them.
+    // Once a write failed the files may end in part of a buffer, so nothing
+    // is saved any more and the last checkpoint stays.
+    int save() {
+        if (_path == nullptr) {
+            return 0;
+        }
+        if (_sinks.failed()) {
+            _failed = true;
+            return -1;
+        }
+        _next = std::chrono::steady_clock::now() + _interval;
+        _state.outputs = _sinks.offsets();
+        if (_sinks.sync() != 0 || _state.save(_path) != 0) {
+            _failed = true;
+            return -1;
+        }
+        return 0;
+    }
+
+    // -1 if any save failed, the last one included.
+    int finish() {
+        return save() == 0 && !_failed ? 0 : -1;
+    }
+
+private:
+    const char* _path;
+    const std::chrono::steady_clock::duration _interval;
+    OutputSinks& _sinks;
+    Checkpoint _state;
+    std::chrono::steady_clock::time_point _next;
+    bool _failed = false;
+};
+
+// Set by SIGINT and SIGTERM while a --follow run waits for input.
+inline volatile sig_atomic_t& follow_stopped() {
+    static volatile sig_atomic_t stopped = 0;
+    return stopped;
+}
+
+// The --input of a --checkpoint or --follow run as a FILE* that starts at a
+// byte offset, read with pread so the offset of every byte is known. With
+// `follow`, reading at the end of the file waits for appended data (inotify,
+// rechecked every second) instead of ending the stream, and only whole lines
+// are read; the stream ends once the file is moved or removed and read to
+// its last newline, or on the first SIGINT or SIGTERM (the second one kills
+// the process). A partial last line is left for the next run.
+class TrackedInput {
+public:
+    TrackedInput() = default;
+    TrackedInput(const TrackedInput&) = delete;
+    TrackedInput& operator=(const TrackedInput&) = delete;
+
+    ~TrackedInput() {
+        close();
+    }
+
+    int open(const char* path, uint64_t offset, bool follow) {
+        _fd = ::open(path, O_RDONLY | O_CLOEXEC);
+        if (_fd < 0) {
+            std::cerr << "Open input [" << path << "] failed." << std::endl;
+            return -1;
+        }
+        char magic[4];
+        ssize_t n = pread(_fd, magic, sizeof(magic), 0);
+        struct stat st;
+        if (n < 0 || fstat(_fd, &st) != 0) {
+            std::cerr << "read input failed." << std::endl;
+            return -1;
+        }
+        if (detect_compression(magic, n) != COMPRESS_NONE) {
+            std::cerr << "--checkpoint and --follow need uncompressed input." << std::endl;
+            return -1;
+        }
+        if (static_cast<uint64_t>(st.st_size) < offset) {
+            std::cerr << "input [" << path << "] is shorter than the checkpoint." << std::endl;
+            return -1;
+        }
+        _offset = offset;
+        _end = offset;
+        _follow = follow;
+        if (follow) {
+            _inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+            if (_inotify < 0 || inotify_add_watch(_inotify, path,
+                    IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF) < 0) {
+                std::cerr << "watch input [" << path << "] failed." << std::endl;
+                return -1;
+            }
+            struct sigaction action = {};
+            action.sa_handler = &TrackedInput::stop;
+            action.sa_flags = SA_RESETHAND;
+            sigemptyset(&action.sa_mask);
+            sigaction(SIGINT, &action, nullptr);
+            sigaction(SIGTERM, &action, nullptr);
+        }
+        cookie_io_functions_t io = {};
+        io.read = &TrackedInput::read_cookie;
+        _stream = fopencookie(this, "r", io);
+        if (_stream == nullptr) {
+            std::cerr << "open input stream failed." << std::endl;
+            return -1;
+        }
+        setvbuf(_stream, nullptr, _IOFBF, 1u << 16);
+        return 0;
+    }
+
+    // called on the reading thread before it waits for appended data; the
+    // stream ends if it returns false.
+    void on_idle(std::function<bool()> idle) {
+        _idle = std::move(idle);
+    }
+
+    FILE* stream() const {
+        return _stream;
+    }
+
+    // -1 if reading failed.
+    int close() {
+        if (_stream != nullptr) {
+            fclose(_stream);
+            _stream = nullptr;
+        }
+        if (_inotify >= 0) {
+            ::close(_inotify);
+            _inotify = -1;
+        }
+        if (_fd >= 0) {
+            ::close(_fd);
+            _fd = -1;
+        }
+        return _failed ? -1 : 0;
+    }
+
+private:
+    static void stop(int) {
+        follow_stopped() = 1;
+    }
+
+    static ssize_t read_cookie(void* cookie, char* buf, size_t size) {
+        return static_cast<TrackedInput*>(cookie)->read(buf, size);
+    }
+
+    ssize_t read(char* buf, size_t size) {
+        while (true) {
+            if (_offset < _end) {
+                ssize_t n = pread(_fd, buf, std::min<uint64_t>(size, _end - _offset), _offset);
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n <= 0) {
+                    return fail("read input failed.");
+                }
+                _offset += n;
+                return n;
+            }
+            if (find_end() != 0) {
+                return -1;
+            }
+            if (_offset < _end) {
+                continue;
+            }
+            if (!_follow || _gone || follow_stopped()) {
+                return 0;
+            }
+            if (_idle && !_idle()) {
+                return 0;
+            }
+            wait();
+        }
+    }
+
+    // moves _end to the end of the file, when following to one past its
+    // last newline.
+    int find_end() {
+        struct stat st;
+        if (fstat(_fd, &st) != 0) {
+            return fail("read input failed.");
+        }
+        // removed; the open descriptor keeps the data readable.
+        if (st.st_nlink == 0u) {
+            _gone = true;
+        }
+        uint64_t size = st.st_size;
+        if (size < _offset) {
+            return fail("input was truncated while following it.");
+        }
+        if (!_follow) {
+            _end = size;
+            return 0;
+        }
+        char block[1 << 16];
+        while (size > _end) {
+            uint64_t from = std::max<uint64_t>(_end,
+                    size > sizeof(block) ? size - sizeof(block) : 0u);
+            ssize_t n = pread(_fd, block, size - from, from);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return fail("read input failed.");
+            }
+            const char* newline = static_cast<const char*>(memrchr(block, '\n', n));
+            if (newline != nullptr) {
+                _end = from + (newline - block) + 1u;
+                break;
+            }
+            size = from;
+        }
+        return 0;
+    }
+
+    void wait() {
+        struct pollfd pfd = {_inotify, POLLIN, 0};
+        if (poll(&pfd, 1, 1000) <= 0) {
+            return;
+        }
+        alignas(struct inotify_event) char events[4096];
+        ssize_t n = 0;
+        while ((n = ::read(_inotify, events, sizeof(events))) > 0) {
+            for (char* p = events; p < events + n;) {
+                const struct inotify_event* event = reinterpret_cast<struct inotify_event*>(p);
+                if (event->mask & (IN_MOVE_SELF | IN_DELETE_SELF)) {
+                    _gone = true;
+                }
+                p += sizeof(struct inotify_event) + event->len;
+            }
+        }
+    }
+
+    int fail(const char* message) {
+        std::cerr << message << std::endl;
+        _failed = true;
+        return -1;
+    }
+
+    int _fd = -1;
+    int _inotify = -1;
+    FILE* _stream = nullptr;
+    bool _follow = false;
+    bool _gone = false;
+    bool _failed = false;
+    uint64_t _offset = 0u;
+    uint64_t _end = 0u;
+    std::function<bool()> _idle;
+};
+
+#endif // DATA_CLEANER_TRACKED_INPUT_H
@@ -0,0 +1,319 @@
+#ifndef DATA_CLEANER_VOCABULARY_H
+#define DATA_CLEANER_VOCABULARY_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+
+// What a vocabulary column does with a sign it has no id for.
+enum VocabPolicy : int {
+    VOCAB_OOV = 0,   // write id 0, reserved for out of vocabulary values
+    VOCAB_SIGN = 1,  // write the MurmurHash sign itself
+    VOCAB_GROW = 2   // assign the next id; the vocabulary is saved at exit
+};
+
+inline int parse_vocab_policy(const char* name, VocabPolicy& policy) {
+    if (strcmp(name, "oov") == 0) {
+        policy = VOCAB_OOV;
+    } else if (strcmp(name, "sign") == 0) {
+        policy = VOCAB_SIGN;
+    } else if (strcmp(name, "grow") == 0) {
+        policy = VOCAB_GROW;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+// One open addressing slot. Ids start at 1, so id 0 marks an empty slot and
+// every 64 bit sign (including 0) can be stored.
+struct VocabSlot {
+    uint64_t sign;
+    uint64_t id;
+};
+
+// Vocabulary file layout, all little endian and 8 byte aligned so the slot
+// arrays can be probed straight from the mapping:
+//   VocabFileHeader
+//   VocabTableHeader x table_count
+//   VocabSlot arrays, each `capacity` long, at their table's `offset`
+struct VocabFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t table_count;
+};
+
+struct VocabTableHeader {
+    uint32_t column;
+    uint32_t reserved;
+    uint64_t capacity;
+    uint64_t size;
+    uint64_t offset;
+};
+
+static const char VOCAB_MAGIC[8] = {'D', 'C', 'V', 'O', 'C', 'A', 'B', '1'};
+static const uint32_t VOCAB_VERSION = 1u;
+
+// sign -> dense id with linear probing. The signs are MurmurHash outputs, so
+// their low bits index the table directly. Slots either belong to the table
+// or are a read only view into a mapped vocabulary file; the first insert
+// into a view copies it. find() may run while one thread inserts: a slot gets
+// its sign before its id, and a grown slot array is published once filled,
+// the replaced ones staying until the table goes (at most as many slots as
+// the current one), so a reader finds a sign or falls back to the insert.
+class VocabTable {
+public:
+    VocabTable() = default;
+    VocabTable(const VocabTable&) = delete;
+    VocabTable& operator=(const VocabTable&) = delete;
+
+    void attach(const VocabSlot* slots, uint64_t capacity, uint64_t size) {
+        std::unique_ptr<Slots> view(new Slots());
+        view->data = slots;
+        view->capacity = capacity;
+        _generations.clear();
+        publish(std::move(view));
+        _size = size;
+    }
+
+    uint64_t size() const {
+        return _size;
+    }
+
+    uint64_t capacity() const {
+        return _generations.empty() ? 0u : _generations.back()->capacity;
+    }
+
+    const VocabSlot* slots() const {
+        return _generations.empty() ? nullptr : _generations.back()->data;
+    }
+
+    // 0 when `sign` has no id.
+    uint64_t find(uint64_t sign) const {
+        const Slots* slots = _current.load(std::memory_order_acquire);
+        if (slots == nullptr || slots->capacity == 0u) {
+            return 0u;
+        }
+        const uint64_t mask = slots->capacity - 1u;
+        for (uint64_t i = sign & mask;; i = (i + 1u) & mask) {
+            const VocabSlot& slot = slots->data[i];
+            uint64_t id = __atomic_load_n(&slot.id, __ATOMIC_ACQUIRE);
+            if (id == 0u || slot.sign == sign) {
+                return id;
+            }
+        }
+    }
+
+    // one thread at a time.
+    uint64_t insert(uint64_t sign) {
+        if (_generations.empty() || _generations.back()->owned.empty()) {
+            rehash(capacity() < 16u ? 16u : capacity());
+        }
+        if ((_size + 1u) * 2u > capacity()) {
+            rehash(capacity() * 2u);
+        }
+        std::vector<VocabSlot>& slots = _generations.back()->owned;
+        const uint64_t mask = slots.size() - 1u;
+        for (uint64_t i = sign & mask;; i = (i + 1u) & mask) {
+            VocabSlot& slot = slots[i];
+            if (slot.id == 0u) {
+                slot.sign = sign;
+                __atomic_store_n(&slot.id, ++_size, __ATOMIC_RELEASE);
+                return slot.id;
+            }
+            if (slot.sign == sign) {
+                return slot.id;
+            }
+        }
+    }
+
+private:
+    // one slot array; `owned` is empty for a view into a mapped file.
+    struct Slots {
+        std::vector<VocabSlot> owned;
+        const VocabSlot* data = nullptr;
+        uint64_t capacity = 0u;
+    };
+
+    void rehash(uint64_t capacity) {
+        std::unique_ptr<Slots> grown(new Slots());
+        grown->owned.assign(capacity, VocabSlot{0u, 0u});
+        grown->data = grown->owned.data();
+        grown->capacity = capacity;
+        const uint64_t mask = capacity - 1u;
+        const VocabSlot* old = slots();
+        for (uint64_t j = 0u; j < this->capacity(); ++j) {
+            const VocabSlot& slot = old[j];
+            if (slot.id == 0u) {
+                continue;
+            }
+            uint64_t i = slot.sign & mask;
+            while (grown->owned[i].id != 0u) {
+                i = (i + 1u) & mask;
+            }
+            grown->owned[i] = slot;
+        }
+        publish(std::move(grown));
+    }
+
+    void publish(std::unique_ptr<Slots> slots) {
+        _generations.push_back(std::move(slots));
+        _current.store(_generations.back().get(), std::memory_order_release);
+    }
+
+    // every slot array of the table, the current one last.
+    std::vector<std::unique_ptr<Slots>> _generations;
+    std::atomic<const Slots*> _current{nullptr};
+    uint64_t _size = 0u;
+};
+
+struct VocabColumn {
+    VocabTable table;
+    VocabPolicy policy = VOCAB_OOV;
+    // only taken with VOCAB_GROW for signs find() misses, the inserts of the
+    // workers go one at a time.
+    std::mutex mutex;
+
+    uint64_t map(uint64_t sign) {
+        uint64_t id = table.find(sign);
+        if (id != 0u) {
+            return id;
+        }
+        if (policy == VOCAB_GROW) {
+            std::lock_guard<std::mutex> lock(mutex);
+            return table.insert(sign);
+        }
+        return policy == VOCAB_SIGN ? sign : 0u;
+    }
+};
+
+// The per column tables of one run, optionally loaded from a vocabulary
+// file that stays mapped read only for the lifetime of the object.
+class Vocabulary {
+public:
+    VocabColumn& add_column(size_t column, VocabPolicy policy) {
+        if (_columns.size() <= column) {
+            _columns.resize(column + 1u);
+        }
+        if (!_columns[column]) {
+            _columns[column].reset(new VocabColumn());
+        }
+        _columns[column]->policy = policy;
+        return *_columns[column];
+    }
+
+    VocabColumn* column(size_t column) {
+        return column < _columns.size() ? _columns[column].get() : nullptr;
+    }
+
+    // `columns` is the column count of the schema; a table for a column past
+    // it, or one whose slots do not hold `size` ids, fails the load.
+    int load(const char* path, size_t columns) {
+        if (_file.open(path) != 0) {
+            return -1;
+        }
+        const char* data = _file.data();
+        size_t size = _file.size();
+        VocabFileHeader header;
+        if (size < sizeof(header)) {
+            std::cerr << "vocabulary file [" << path << "] is truncated." << std::endl;
+            return -1;
+        }
+        memcpy(&header, data, sizeof(header));
+        if (memcmp(header.magic, VOCAB_MAGIC, sizeof(VOCAB_MAGIC)) != 0 ||
+                header.version != VOCAB_VERSION) {
+            std::cerr << "[" << path << "] is not a vocabulary file." << std::endl;
+            return -1;
+        }
+        size_t tables_end = sizeof(header) + header.table_count * sizeof(VocabTableHeader);
+        if (tables_end > size) {
+            std::cerr << "vocabulary file [" << path << "] is truncated." << std::endl;
+            return -1;
+        }
+        for (uint32_t t = 0u; t < header.table_count; ++t) {
+            VocabTableHeader table;
+            memcpy(&table, data + sizeof(header) + t * sizeof(table), sizeof(table));
+            bool power_of_two = (table.capacity & (table.capacity - 1u)) == 0u;
+            bool fits = table.capacity == 0u ? table.size == 0u : table.size < table.capacity;
+            if (table.column >= columns || !power_of_two || !fits ||
+                    table.offset % alignof(VocabSlot) != 0u ||
+                    table.offset > size || table.capacity > (size - table.offset) / sizeof(VocabSlot)) {
+                std::cerr << "vocabulary file [" << path << "] has a bad table for column "
+                          << table.column << std::endl;
+                return -1;
+            }
+            const VocabSlot* slots = reinterpret_cast<const VocabSlot*>(data + table.offset);
+            // size < capacity leaves an empty slot, which ends every probe.
+            uint64_t used = 0u;
+            for (uint64_t i = 0u; i < table.capacity; ++i) {
+                used += slots[i].id != 0u;
+            }
+            if (used != table.size) {
+                std::cerr << "vocabulary file [" << path << "] has a bad table for column "
+                          << table.column << std::endl;
+                return -1;
+            }
+            VocabColumn& column = add_column(table.column, VOCAB_OOV);
+            column.table.attach(slots, table.capacity, table.size);
+        }
+        return 0;
+    }
+
+    int save(const char* path) const {
+        std::vector<VocabTableHeader> tables;
+        uint64_t offset = sizeof(VocabFileHeader);
+        for (size_t i = 0u; i < _columns.size(); ++i) {
+            if (_columns[i]) {
+                VocabTableHeader table = {static_cast<uint32_t>(i), 0u,
+                    _columns[i]->table.capacity(), _columns[i]->table.size(), 0u};
+                tables.push_back(table);
+                offset += sizeof(VocabTableHeader);
+            }
+        }
+        for (auto& table : tables) {
+            table.offset = offset;
+            offset += table.capacity * sizeof(VocabSlot);
+        }
+
+        std::string tmp = std::string(path) + ".tmp";
+        FILE* file = fopen(tmp.c_str(), "wb");
+        if (file == nullptr) {
+            std::cerr << "Open vocabulary file [" << tmp << "] failed." << std::endl;
+            return -1;
+        }
+        VocabFileHeader header;
+        memcpy(header.magic, VOCAB_MAGIC, sizeof(VOCAB_MAGIC));
+        header.version = VOCAB_VERSION;
+        header.table_count = tables.size();
+        bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+        if (!tables.empty()) {
+            ok = ok && fwrite(tables.data(), sizeof(VocabTableHeader), tables.size(), file) ==
+                tables.size();
+        }
+        for (const auto& table : tables) {
+            const VocabTable& t = _columns[table.column]->table;
+            ok = ok && fwrite(t.slots(), sizeof(VocabSlot), t.capacity(), file) == t.capacity();
+        }
+        ok = (fclose(file) == 0) && ok;
+        if (!ok || rename(tmp.c_str(), path) != 0) {
+            std::cerr << "write vocabulary file [" << path << "] failed." << std::endl;
+            remove(tmp.c_str());
+            return -1;
+        }
+        return 0;
+    }
+
+private:
+    MappedFile _file;
+    std::vector<std::unique_ptr<VocabColumn>> _columns;
+};
+
+#endif // DATA_CLEANER_VOCABULARY_H
@@ -0,0 +1,182 @@
+#include "data_cleaner.h"
+
+#include <atomic>
+#include <iostream>
+
+#include "../common/bucket_fit.h"
+#include "../common/chunk_pipeline.h"
+#include "../common/column_plan.h"
+#include "../common/diagnostics.h"
+#include "../common/dialects.h"
+#include "../common/output_sinks.h"
+#include "../common/row_format.h"
+#include "../common/str_view.h"
+#include "../common/vocabulary.h"
+
+static_assert(+CLEANED_DOUBLE == +ROW_SLOT_DOUBLE && +CLEANED_INT == +ROW_SLOT_INT &&
+        +CLEANED_SIGNS == +ROW_SLOT_SIGNS, "slot types follow row_format.h");
+static_assert(+CLEANED_VALUE == +ROW_ROLE_VALUE && +CLEANED_MAX == +ROW_ROLE_MAX &&
+        +CLEANED_MIN == +ROW_ROLE_MIN && +CLEANED_WEIGHT == +ROW_ROLE_WEIGHT, "slot roles follow row_format.h");
+
+static CleanerDialect variant_dialect(CleanerVariant variant) {
+    switch (variant) {
+    case CLEANER_ROOT:
+        return root_dialect();
+    case CLEANER_CLEANING:
+        return cleaning_dialect();
+    default:
+        return format_dialect();
+    }
+}
+
+// The plan is compiled for binary rows; RowEncoder keeps the words of every
+// row and the labels are taken from the tokens instead of being written.
+struct Cleaner::Impl {
+    Impl() : id(next_id()) {}
+
+    static uint64_t next_id() {
+        static std::atomic<uint64_t> ids{0u};
+        return ++ids;
+    }
+
+    // batches keep scratch state for the plan with this id.
+    const uint64_t id;
+    ColumnPlan plan;
+    Vocabulary vocabulary;
+    std::vector<CleanedSlot> slots;
+};
+
+// The per thread state of clean(), kept in the batch between calls.
+struct CleanedBatch::Scratch {
+    Scratch(uint64_t plan_id, const ColumnPlan& plan)
+        : plan_id(plan_id), thread(plan, counters), output(false) {}
+
+    const uint64_t plan_id;
+    DiagnosticCounters counters;
+    ThreadContext thread;
+    SinkBuffers output;
+};
+
+CleanedBatch::CleanedBatch() {
+}
+
+CleanedBatch::~CleanedBatch() {
+}
+
+CleanerLine CleanedBatch::diagnostics() const {
+    if (!_scratch) {
+        return CleanerLine{"", 0u};
+    }
+    const OutputBuffer& diag = _scratch->output.diagnostics;
+    return CleanerLine{diag.data(), diag.size()};
+}
+
+Cleaner::Cleaner() : _impl(new Impl()) {
+}
+
+Cleaner::~Cleaner() {
+}
+
+void Cleaner::finish_schema() {
+    ColumnPlan& plan = _impl->plan;
+    _impl->slots.clear();
+    for (auto& column : plan.columns) {
+        if (column.oflag == Oflag::LABEL) {
+            column.handler = handle_ignore;
+        }
+    }
+    for (const auto& slot : plan.slots) {
+        _impl->slots.push_back({slot.column, static_cast<CleanedSlotType>(slot.type),
+            static_cast<CleanedSlotRole>(slot.role)});
+    }
+}
+
+int Cleaner::load_schema(const char* path, CleanerVariant variant) {
+    _impl.reset(new Impl());
+    _impl->plan.format = OUTPUT_BINARY;
+    if (parse_feature_flags(path, variant_dialect(variant), _impl->plan) != 0) {
+        std::cerr << "Parse feature flag file failed." << std::endl;
+        return -1;
+    }
+    finish_schema();
+    return 0;
+}
+
+int Cleaner::parse_schema(const std::string& schema, CleanerVariant variant) {
+    _impl.reset(new Impl());
+    _impl->plan.format = OUTPUT_BINARY;
+    CleanerDialect dialect = variant_dialect(variant);
+    int ret = 0;
+    for_each_line(schema.data(), schema.size(), [&](StrView line) {
+        if (ret == 0 && add_feature_flag(line, dialect, _impl->plan) != 0) {
+            ret = -1;
+        }
+    });
+    if (ret != 0) {
+        std::cerr << "Parse feature flags failed." << std::endl;
+        return -1;
+    }
+    finish_schema();
+    return 0;
+}
+
+int Cleaner::load_vocabulary(const char* path) {
+    if (_impl->vocabulary.load(path, _impl->plan.columns.size()) != 0) {
+        return -1;
+    }
+    for (auto& column : _impl->plan.columns) {
+        if (column.oflag == CAT || column.oflag == MULTI_CAT || column.oflag == MULTI_CAT_NUM) {
+            column.vocab = &_impl->vocabulary.add_column(column.index, VOCAB_OOV);
+        }
+    }
+    return 0;
+}
+
+int Cleaner::load_buckets(const char* path) {
+    return load_bucket_bounds(path, _impl->plan);
+}
+
+const std::vector<CleanedSlot>& Cleaner::slots() const {
+    return _impl->slots;
+}
+
+void Cleaner::clean_one(CleanerLine line, CleanedBatch& batch) const {
+    const ColumnPlan& plan = _impl->plan;
+    ThreadContext& thread = batch._scratch->thread;
+    LineContext ctx = line_context(thread, batch._scratch->output);
+    const auto& tokens = split_columns(plan, StrView{line.data, line.size}, ctx);
+    thread.rows.begin();
+    handle_columns(plan, tokens, ctx);
+    thread.rows.finish(batch._words, batch._ends);
+    if (plan.label_column < tokens.size()) {
+        const StrView& label = tokens[plan.label_column];
+        batch._labels.push_back(CleanerLine{label.data, label.size});
+    } else {
+        batch._labels.push_back(CleanerLine{"", 0u});
+    }
+}
+
+void Cleaner::begin_batch(CleanedBatch& batch) const {
+    if (!batch._scratch || batch._scratch->plan_id != _impl->id) {
+        batch._scratch.reset(new CleanedBatch::Scratch(_impl->id, _impl->plan));
+    }
+    batch._scratch->output.diagnostics.clear();
+    batch._words.clear();
+    batch._ends.clear();
+    batch._labels.clear();
+    batch._slot_count = _impl->plan.slots.size();
+}
+
+void Cleaner::clean(const CleanerLine* lines, size_t count, CleanedBatch& batch) const {
+    begin_batch(batch);
+    for (size_t i = 0u; i < count; ++i) {
+        clean_one(lines[i], batch);
+    }
+}
+
+void Cleaner::clean(const char* data, size_t size, CleanedBatch& batch) const {
+    begin_batch(batch);
+    for_each_line(data, size, [this, &batch](StrView line) {
+        clean_one(CleanerLine{line.data, line.size}, batch);
+    });
+}
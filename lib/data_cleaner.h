@@ -0,0 +1,165 @@
+#ifndef DATA_CLEANER_LIB_DATA_CLEANER_H
+#define DATA_CLEANER_LIB_DATA_CLEANER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+// In process interface to the cleaner, built as lib/libdata_cleaner.a by
+// `make lib`. A Cleaner compiles a schema once; clean() then turns batches of
+// raw lines into rows of 64 bit words, the values the binary row format
+// would hold, without formatting any text. Only this header is needed to
+// use the library.
+
+// The dialect of one of the data_clean front ends.
+enum CleanerVariant : int {
+    CLEANER_ROOT = 0,       // data_clean
+    CLEANER_CLEANING = 1,   // data_cleaning/data_clean
+    CLEANER_FORMAT = 2      // data_format/data_clean
+};
+
+// What a slot of a cleaned row holds: DOUBLE and INT slots at most one word,
+// the bits of a double or an int64 (Time), except the WEIGHT slot of a
+// Weighted CatNumerical column, which holds a double per key; SIGNS a list of
+// signs or, with a vocabulary, dense ids.
+enum CleanedSlotType : uint8_t {
+    CLEANED_DOUBLE = 0,
+    CLEANED_INT = 1,
+    CLEANED_SIGNS = 2
+};
+
+// Which part of its schema column a slot holds; Multi-Valued CatNumerical
+// columns have a slot for the keys and one for the max and/or min key (the
+// TopK or BottomK keys, best first), or for the values of the keys.
+enum CleanedSlotRole : uint8_t {
+    CLEANED_VALUE = 0,
+    CLEANED_MAX = 1,
+    CLEANED_MIN = 2,
+    CLEANED_WEIGHT = 3
+};
+
+struct CleanedSlot {
+    uint32_t column;
+    CleanedSlotType type;
+    CleanedSlotRole role;
+};
+
+// A line of input, or a piece of one.
+struct CleanerLine {
+    const char* data;
+    size_t size;
+};
+
+struct CleanerWords {
+    const uint64_t* data;
+    size_t size;
+};
+
+// The rows produced by one Cleaner::clean() call. Values stay valid until
+// the batch is cleaned into again, labels as long as the input lines.
+class CleanedBatch {
+public:
+    CleanedBatch();
+    ~CleanedBatch();
+    CleanedBatch(const CleanedBatch&) = delete;
+    CleanedBatch& operator=(const CleanedBatch&) = delete;
+
+    size_t size() const {
+        return _labels.size();
+    }
+
+    size_t slot_count() const {
+        return _slot_count;
+    }
+
+    // the words of `slot` in `row`; none if the value is null.
+    CleanerWords values(size_t row, size_t slot) const {
+        size_t i = row * _slot_count + slot;
+        size_t begin = i == 0u ? 0u : _ends[i - 1u];
+        return CleanerWords{_words.data() + begin, _ends[i] - begin};
+    }
+
+    bool is_null(size_t row, size_t slot) const {
+        return values(row, slot).size == 0u;
+    }
+
+    // the value of a DOUBLE slot, NaN if it is null.
+    double number(size_t row, size_t slot) const {
+        CleanerWords words = values(row, slot);
+        if (words.size == 0u) {
+            return __builtin_nan("");
+        }
+        double value = 0.0;
+        memcpy(&value, words.data, sizeof(value));
+        return value;
+    }
+
+    // the value of an INT slot, 0 if it is null.
+    int64_t integer(size_t row, size_t slot) const {
+        CleanerWords words = values(row, slot);
+        return words.size == 0u ? 0 : static_cast<int64_t>(words.data[0]);
+    }
+
+    // the Label token of `row` as it is in the input; empty if there is none.
+    CleanerLine label(size_t row) const {
+        return _labels[row];
+    }
+
+    // the diagnostics of the batch, one per line, as the CLI writes them.
+    CleanerLine diagnostics() const;
+
+private:
+    friend class Cleaner;
+    struct Scratch;
+
+    std::vector<uint64_t> _words;
+    std::vector<size_t> _ends;
+    std::vector<CleanerLine> _labels;
+    size_t _slot_count = 0u;
+    std::unique_ptr<Scratch> _scratch;
+};
+
+// A compiled schema. clean() may run on several threads at once, as long as
+// every thread cleans into a batch of its own.
+class Cleaner {
+public:
+    Cleaner();
+    ~Cleaner();
+    Cleaner(const Cleaner&) = delete;
+    Cleaner& operator=(const Cleaner&) = delete;
+
+    // Compiles a schema file, or schema text with one flag per line, as the
+    // front end of `variant` would; -1 with the reason on stderr if it is
+    // malformed.
+    int load_schema(const char* path, CleanerVariant variant);
+    int parse_schema(const std::string& schema, CleanerVariant variant);
+
+    // Maps categorical values to the dense ids of a --vocab-out file;
+    // unseen values map to 0. Call it after the schema is loaded.
+    int load_vocabulary(const char* path);
+
+    // Installs the Numerical#Bucket boundaries of a --fit-buckets file; until
+    // then every value of such a column falls into bucket 0.
+    int load_buckets(const char* path);
+
+    const std::vector<CleanedSlot>& slots() const;
+
+    // Cleans `count` lines, or the '\n' separated lines in [data, data+size),
+    // into `batch`, replacing what it held.
+    void clean(const CleanerLine* lines, size_t count, CleanedBatch& batch) const;
+    void clean(const char* data, size_t size, CleanedBatch& batch) const;
+
+private:
+    struct Impl;
+
+    void finish_schema();
+    void begin_batch(CleanedBatch& batch) const;
+    void clean_one(CleanerLine line, CleanedBatch& batch) const;
+
+    std::unique_ptr<Impl> _impl;
+};
+
+#endif // DATA_CLEANER_LIB_DATA_CLEANER_H
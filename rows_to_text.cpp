@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "common/mapped_file.h"
+#include "common/output_buffer.h"
+#include "common/row_format.h"
+
+// Prints a --format binary instance stream as text for debugging: one line
+// per row, slots separated by spaces, sign and weight lists joined by ','
+// and null slots as NaN.
+int main(int argc, char* argv[]) {
+    if (argc > 2) {
+        std::cerr << "Usage: " << argv[0] << " [binary rows file]" << std::endl;
+        return -1;
+    }
+    MappedFile file;
+    std::string input;
+    const char* data = nullptr;
+    size_t size = 0u;
+    if (argc == 2) {
+        if (file.open(argv[1]) != 0) {
+            return -1;
+        }
+        data = file.data();
+        size = file.size();
+    } else {
+        char buf[1 << 16];
+        ssize_t ret = 0;
+        while ((ret = read(STDIN_FILENO, buf, sizeof(buf))) > 0) {
+            input.append(buf, ret);
+        }
+        data = input.data();
+        size = input.size();
+    }
+
+    RowReader reader;
+    if (reader.open(data, size) != 0) {
+        std::cerr << "input is not a binary row stream." << std::endl;
+        return -1;
+    }
+    const auto& slots = reader.slots();
+    const size_t FLUSH_SIZE = 1u << 20;
+    OutputBuffer out(FLUSH_SIZE * 2u);
+    RowView row;
+    std::vector<uint64_t> signs;
+    std::vector<double> numbers;
+    int ret = 0;
+    while ((ret = reader.next(row)) > 0) {
+        for (size_t i = 0u; i < slots.size(); ++i) {
+            if (i != 0u) {
+                out << ' ';
+            }
+            if (row.is_null(i)) {
+                out << "NaN";
+            } else if (slots[i].type == ROW_SLOT_DOUBLE) {
+                row.numbers(i, numbers);
+                for (size_t j = 0u; j < numbers.size(); ++j) {
+                    if (j != 0u) {
+                        out << ',';
+                    }
+                    out << numbers[j];
+                }
+            } else if (slots[i].type == ROW_SLOT_INT) {
+                out << static_cast<long long>(row.integer(i));
+            } else {
+                row.signs(i, signs);
+                for (size_t j = 0u; j < signs.size(); ++j) {
+                    if (j != 0u) {
+                        out << ',';
+                    }
+                    out << static_cast<unsigned long long>(signs[j]);
+                }
+            }
+        }
+        out << '\n';
+        if (out.size() >= FLUSH_SIZE) {
+            out.flush_to(STDOUT_FILENO);
+        }
+    }
+    out.flush_to(STDOUT_FILENO);
+    if (ret < 0) {
+        std::cerr << "corrupt row in binary row stream." << std::endl;
+        return -1;
+    }
+    return 0;
+}